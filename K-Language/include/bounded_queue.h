@@ -0,0 +1,111 @@
+#pragma once
+
+#include "common.h"
+
+#include <atomic>
+
+namespace k::utils
+{
+	/*
+	 * Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design). Every cell carries a sequence
+	 * number telling whether it is ready for the producer or the consumer at a given position, so a push or a pop is
+	 * one compare-and-swap on its own position counter and threads only meet on the cells they actually share.
+	 */
+	template<typename _Ty>
+	class BoundedQueue
+	{
+	private:
+		static constexpr Size cache_line = 64;
+
+		struct Cell
+		{
+			std::atomic<Size> sequence;
+			alignas(_Ty) Byte storage[sizeof(_Ty)];
+
+			inline _Ty& value() { return *reinterpret_cast<_Ty*>(storage); }
+		};
+
+		Cell* _cells;
+		Size _mask;
+
+		alignas(cache_line) std::atomic<Size> _enqueue{ 0 };
+		alignas(cache_line) std::atomic<Size> _dequeue{ 0 };
+
+	public:
+		/* The capacity is rounded up to a power of two */
+		explicit BoundedQueue(Size capacity) :
+			_cells(nullptr),
+			_mask(std::bit_ceil(std::max<Size>(capacity, 2)) - 1)
+		{
+			_cells = new Cell[_mask + 1];
+			for (Size i = 0; i <= _mask; ++i)
+				_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		~BoundedQueue()
+		{
+			for (Size position = _dequeue.load(); position != _enqueue.load(); ++position)
+				std::destroy_at(&_cells[position & _mask].value());
+			delete[] _cells;
+		}
+
+		BoundedQueue(const BoundedQueue&) = delete;
+		BoundedQueue& operator= (const BoundedQueue&) = delete;
+
+		inline Size capacity() const { return _mask + 1; }
+
+		/* Approximate while other threads are pushing or popping */
+		inline Size size() const { return _enqueue.load(std::memory_order_relaxed) - _dequeue.load(std::memory_order_relaxed); }
+
+		/* False if the queue is full, value is then left untouched */
+		bool try_push(_Ty&& value)
+		{
+			Cell* cell;
+			Size position = _enqueue.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				cell = &_cells[position & _mask];
+				std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(cell->sequence.load(std::memory_order_acquire)) - static_cast<std::ptrdiff_t>(position);
+				if (difference == 0)
+				{
+					if (_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (difference < 0)
+					return false;
+				else
+					position = _enqueue.load(std::memory_order_relaxed);
+			}
+
+			std::construct_at(&cell->value(), std::move(value));
+			cell->sequence.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		/* False if the queue is empty */
+		bool try_pop(_Ty& value)
+		{
+			Cell* cell;
+			Size position = _dequeue.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				cell = &_cells[position & _mask];
+				std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(cell->sequence.load(std::memory_order_acquire)) - static_cast<std::ptrdiff_t>(position + 1);
+				if (difference == 0)
+				{
+					if (_dequeue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (difference < 0)
+					return false;
+				else
+					position = _dequeue.load(std::memory_order_relaxed);
+			}
+
+			value = std::move(cell->value());
+			std::destroy_at(&cell->value());
+			cell->sequence.store(position + _mask + 1, std::memory_order_release);
+			return true;
+		}
+	};
+}
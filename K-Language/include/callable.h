@@ -8,6 +8,8 @@ namespace k
 	{
 	private:
 		const Chunk* _chunk = nullptr;
+		/* Name held by the Function owning this Callable, for the frames that do not hold the Function itself */
+		const std::string* _name = nullptr;
 
 		data::Value* _ups = nullptr;
 		Size _upsCount = 0;
@@ -21,7 +23,7 @@ namespace k
 		Callable& operator= (const Callable&) = delete;
 
 	public:
-		Callable(const Chunk& chunk, Size upsCount);
+		Callable(const Chunk& chunk, Size upsCount, const std::string* name = nullptr);
 
 		Callable(Callable&& right) noexcept;
 		Callable& operator= (Callable&& right) noexcept;
@@ -30,6 +32,7 @@ namespace k
 
 	public:
 		inline const Chunk& chunk() const { return *_chunk; }
+		inline std::string_view name() const { return _name ? std::string_view(*_name) : std::string_view(); }
 
 		inline Size upsCount() const { return _upsCount; }
 
@@ -63,6 +66,7 @@ namespace k
 		{
 			return _chunk->instruction(offset);
 		}
+		inline const instruction::InstructionValue* code() const { return _chunk->code(); }
 		inline Size instructionsCount() const { return _chunk->instructionsCount(); }
 
 		inline Size varsCount() const { return _chunk->varsCount(); }
@@ -72,5 +76,7 @@ namespace k
 	public:
 		void setUps(const data::Value* src);
 		void getUps(data::Value* dst);
+
+		void traverse(mem::BlockVisitor& visitor);
 	};
 }
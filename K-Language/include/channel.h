@@ -0,0 +1,47 @@
+#pragma once
+
+#include "parcel.h"
+#include "bounded_queue.h"
+
+#include <memory>
+
+namespace k::runtime
+{
+	/*
+	 * Bounded queue of Parcels between threads, each end working on its own Heap. A sent graph is detached from
+	 * the sender's Heap and rebuilt in the receiver's, its element stores and buffers change hands without a copy.
+	 * Scripts reach a Channel through an endpoint, a TypedUserdata<std::shared_ptr<Channel>> owned by one Heap.
+	 */
+	class Channel
+	{
+	public:
+		enum class Status : UInt8 { Sent, Full, Rejected };
+
+		static constexpr Size default_capacity = 1024;
+
+	private:
+		utils::BoundedQueue<mem::Parcel> _queue;
+
+	public:
+		explicit Channel(Size capacity = default_capacity);
+
+		Channel(const Channel&) = delete;
+		Channel& operator= (const Channel&) = delete;
+
+		inline Size capacity() const { return _queue.capacity(); }
+
+		/*
+		 * Moves value into the channel and leaves it undefined. value is left untouched if it is Rejected because a
+		 * block of its graph is shared with the rest of heap, see mem::Parcel::pack, and usually when the channel is
+		 * Full. Only when another sender takes the last slot while value is being packed is it Full with value
+		 * replaced by the graph rebuilt from the parcel: equal content, but new blocks and no interned strings.
+		 */
+		Status send(mem::Heap& heap, data::Value& value);
+
+		/* False if the channel is empty */
+		bool receive(mem::Heap& heap, data::Value& value);
+
+	public:
+		static data::Value endpoint(mem::Heap& heap, const std::shared_ptr<Channel>& channel);
+	};
+}
@@ -2,6 +2,13 @@
 
 #include "instructions.h"
 #include "data.h"
+#include "inline_cache.h"
+
+namespace k::image
+{
+	struct ConstantRecord;
+	class MappedImage;
+}
 
 namespace k
 {
@@ -100,8 +107,10 @@ namespace k
 		Chunk* _chunks = nullptr;
 		Size _chunkCount = 0;
 
+		/* The root of a chunk tree owns one deduplicated pool, every nested chunk indexes into it */
 		data::Value* _constants = nullptr;
 		Size _constantsCount = 0;
+		bool _sharedConstants = false;
 
 		instruction::InstructionValue* _instructions = nullptr;
 		Size _instructionsCount = 0;
@@ -109,6 +118,18 @@ namespace k
 		Size _varsCount = 0;
 		Size _tempsCount = 0;
 
+		/* One per property access instruction, its cache operand is the index assigned at construction */
+		runtime::PropertyCache* _propertyCaches = nullptr;
+		Size _propertyCachesCount = 0;
+
+		/* Set for chunks running over a mapped image: the code is borrowed and the constants are built on first use */
+		bool _mappedCode = false;
+		mutable const image::ConstantRecord* _pendingConstants = nullptr;
+		const char* _strings = nullptr;
+
+		/* Writable copy of the code that execute quickens in place, followed by one polymorphic bit per offset */
+		mutable instruction::InstructionValue* _quickened = nullptr;
+
 	public:
 		Chunk() = default;
 
@@ -116,6 +137,10 @@ namespace k
 		Chunk& operator= (const Chunk&) = delete;
 
 	public:
+		/*
+		 * Optimizes and verifies the code, throws error::BytecodeError. tempsCount is recomputed by the verifier.
+		 * The constants of the chunks are merged into this chunk's pool and their operands renumbered.
+		 */
 		Chunk(
 			mem::Heap& heap,
 			Chunk* chunks,
@@ -170,5 +195,54 @@ namespace k
 		inline Size varsCount() const { return _varsCount; }
 		inline Size tempsCount() const { return _tempsCount; }
 		inline Size stackCount() const { return _varsCount + _tempsCount; }
+
+		inline runtime::PropertyCache& propertyCache(Offset offset) const { return _propertyCaches[offset]; }
+		inline Size propertyCachesCount() const { return _propertyCachesCount; }
+
+		inline bool isMapped() const { return _mappedCode; }
+
+		/* Builds the pending constants of a mapped chunk, no-op otherwise. Callable does it before any execution */
+		void materialize_constants() const;
+
+		/* Shadow code, null until the first quickening */
+		inline const instruction::InstructionValue* quickenedData() const { return _quickened; }
+
+		/* Code execute runs: the generic (or mapped) code until something is quickened, the shadow code after */
+		inline const instruction::InstructionValue* code() const { return _quickened ? _quickened : _instructions; }
+
+		/* Set once an instruction has been de-quickened: its operand types vary and it stays generic */
+		inline bool isPolymorphic(Offset offset) const
+		{
+			return _quickened && ((_quickened[_instructionsCount + offset / 8] >> (offset % 8)) & 1);
+		}
+
+		/* Rewrites the instruction at offset as opcode unless it is polymorphic, building the shadow code first */
+		inline void quicken(Offset offset, Opcode opcode) const
+		{
+			if (!_quickened)
+				materialize_code();
+			else if (isPolymorphic(offset))
+				return;
+			_quickened[offset] = static_cast<instruction::InstructionValue>(opcode);
+		}
+
+		/* Restores the generic opcode after a failed quickening guard */
+		inline void dequicken(Offset offset) const
+		{
+			_quickened[offset] = _instructions[offset];
+			_quickened[_instructionsCount + offset / 8] |= static_cast<instruction::InstructionValue>(1 << (offset % 8));
+		}
+
+	private:
+		/* assign = false checks that the cache operands are already numbered, throws error::BytecodeError */
+		void link_property_caches(bool assign = true);
+		void allocate_property_caches(Size count);
+		void adopt_constants(data::Value* pool, Size count);
+
+		/* Builds the shadow code as a copy of the generic code, followed by a cleared polymorphic bitmap */
+		void materialize_code() const;
+
+	public:
+		friend class image::MappedImage;
 	};
 }
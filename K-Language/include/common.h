@@ -1,6 +1,7 @@
 #pragma once
 
 #include <unordered_map>
+#include <algorithm>
 #include <type_traits>
 #include <exception>
 #include <iostream>
@@ -10,6 +11,54 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <chrono>
+#include <bit>
+#include <string_view>
+#include <stdexcept>
+#include <memory>
+#include <limits>
+
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#	define K_UNREACHABLE() __assume(0)
+#else
+#	define K_UNREACHABLE() __builtin_unreachable()
+#endif
+
+/* data::Value encoding: 1 = 8-byte NaN-boxed, 0 = 16-byte type tag + union */
+#if !defined(K_NAN_BOXING)
+#	if UINTPTR_MAX == UINT64_MAX
+#		define K_NAN_BOXING 1
+#	else
+#		define K_NAN_BOXING 0
+#	endif
+#endif
+
+/* Deferred reference counting: 1 = ValueStack slots hold uncounted references, reconciled through a zero-count table */
+#if !defined(K_DEFERRED_RC)
+#	define K_DEFERRED_RC 0
+#endif
+
+/* Interpreter statistics: 1 = count every executed opcode pair, see runtime::report_opcode_pairs */
+#if !defined(K_OPCODE_PAIR_STATS)
+#	define K_OPCODE_PAIR_STATS 0
+#endif
+
+/* Script profiler: 1 = execute reports every dispatch to the runtime::Profiler of its state, see profiler.h */
+#if !defined(K_PROFILER)
+#	define K_PROFILER 0
+#endif
+
+/* Interpreter dispatch: 1 = direct-threaded (label table + computed goto), 0 = portable switch */
+#if !defined(K_THREADED_DISPATCH)
+#	if defined(__GNUC__) || defined(__clang__)
+#		define K_THREADED_DISPATCH 1
+#	else
+#		define K_THREADED_DISPATCH 0
+#	endif
+#elif K_THREADED_DISPATCH && !(defined(__GNUC__) || defined(__clang__))
+#	error "K_THREADED_DISPATCH requires the labels-as-values extension (GCC or Clang)"
+#endif
 
 namespace k
 {
@@ -67,6 +116,45 @@ namespace k::utils
 	}
 
 
+	/* Checked signed arithmetic, true on overflow. *result holds the wrapped value either way */
+	inline bool add_overflow(Int64 left, Int64 right, Int64* result)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_add_overflow(left, right, result);
+#else
+		*result = static_cast<Int64>(static_cast<UInt64>(left) + static_cast<UInt64>(right));
+		return ((left ^ *result) & (right ^ *result)) < 0;
+#endif
+	}
+
+	inline bool sub_overflow(Int64 left, Int64 right, Int64* result)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_sub_overflow(left, right, result);
+#else
+		*result = static_cast<Int64>(static_cast<UInt64>(left) - static_cast<UInt64>(right));
+		return ((left ^ right) & (left ^ *result)) < 0;
+#endif
+	}
+
+	inline bool mul_overflow(Int64 left, Int64 right, Int64* result)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_mul_overflow(left, right, result);
+#elif defined(_M_X64)
+		Int64 high;
+		*result = _mul128(left, right, &high);
+		return high != (*result >> 63);
+#else
+		*result = static_cast<Int64>(static_cast<UInt64>(left) * static_cast<UInt64>(right));
+		/* -1 * min overflows, and dividing min by -1 to find out would trap */
+		if (left == -1 && right == std::numeric_limits<Int64>::min())
+			return true;
+		return left != 0 && *result / left != right;
+#endif
+	}
+
+
 	template<typename _ValueTy, typename _MinTy, typename _MaxTy>
 	constexpr _ValueTy clamp(_ValueTy value, _MinTy min, _MaxTy max)
 	{
@@ -93,4 +181,11 @@ namespace k::error
 		inline RuntimeError(const char* msg) noexcept : exception(msg) {}
 		inline RuntimeError(const std::string& msg) noexcept : exception(msg.c_str()) {}
 	};
+
+	class BytecodeError : public std::exception
+	{
+	public:
+		inline BytecodeError(const char* msg) noexcept : exception(msg) {}
+		inline BytecodeError(const std::string& msg) noexcept : exception(msg.c_str()) {}
+	};
 }
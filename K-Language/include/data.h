@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include "slab.h"
 
 namespace k
 {
@@ -13,19 +14,74 @@ namespace k::runtime
 	class RuntimeState;
 }
 
-namespace k::data { class Value; }
+namespace k::data
+{
+	class Value;
+	class String;
+}
 
 namespace k::mem
 {
 	class Heap;
+	class MemoryBlock;
+	class SharedRegion;
+	class Parcel;
+
+	class BlockVisitor
+	{
+	public:
+		virtual void visit(MemoryBlock* block) = 0;
+
+		inline void operator() (const data::Value& value);
+	};
+
+	/* A set of Values outside of any block (e.g. a ValueStack) that a Heap must treat as roots */
+	class RootSet
+	{
+	private:
+		std::vector<Heap*> _heaps;
+
+	public:
+		RootSet() = default;
+		virtual ~RootSet();
+
+		RootSet(const RootSet&) = delete;
+		RootSet& operator= (const RootSet&) = delete;
+
+	public:
+		virtual void scan_roots(BlockVisitor& visitor) = 0;
+
+	protected:
+		/* Derived sets call it before dropping their values, a Heap may still have to unpin them */
+		void detach_all();
+
+		friend class Heap;
+	};
 
 	class MemoryBlock
 	{
+	public:
+		/* Blocks of acyclic types can never be part of a reference cycle, the cycle collector skips them */
+		static constexpr bool acyclic = false;
+
+	private:
+		enum class Color : UInt8 { Black, Gray, White, Purple };
+
+		static constexpr UInt8 flag_buffered = 0x1;
+		static constexpr UInt8 flag_acyclic = 0x2;
+		static constexpr UInt8 flag_zct = 0x4;
+		static constexpr UInt8 flag_stack = 0x8;
+		static constexpr UInt8 flag_interned = 0x10;
+		static constexpr UInt8 flag_frozen = 0x20;
+
 	private:
 		Heap* _owner = nullptr;
 		MemoryBlock* _next = nullptr;
 		MemoryBlock* _prev = nullptr;
-		std::uintmax_t _refs = 0;
+		UInt32 _refs = 0;
+		UInt8 _sizeClass = SlabAllocator::large_class;
+		Color _color = Color::Black;
+		UInt8 _flags = 0;
 
 	public:
 		#pragma warning(push)
@@ -38,14 +94,24 @@ namespace k::mem
 		MemoryBlock(const MemoryBlock&) = delete;
 		MemoryBlock& operator= (const MemoryBlock&) = delete;
 
-		inline void inc_ref() { ++_refs; }
+		/* Frozen blocks are read by several threads at once, their count is never touched */
+		inline void inc_ref() { if (!(_flags & flag_frozen)) ++_refs; }
 		void dec_ref();
 
+		inline Heap* owner() const { return _owner; }
+
+		/* Immutable and owned by a SharedRegion instead of a Heap */
+		inline bool isFrozen() const { return _flags & flag_frozen; }
+
 		friend class Heap;
+		friend class SharedRegion;
+		friend class Parcel;
 		friend class data::Value;
+		friend class data::String;
 
 	protected:
-
+		/* Passes every Value held by this block to the visitor; used by the cycle collector */
+		virtual void traverse(BlockVisitor&) {}
 	};
 }
 
@@ -79,6 +145,7 @@ namespace k::data
 
 	class String;
 	class Array;
+	class Shape;
 	class Object;
 	class Function;
 	class Userdata;
@@ -86,41 +153,94 @@ namespace k::data
 	class Value
 	{
 	private:
+#if K_NAN_BOXING
+		/*
+		 * NaN-boxed layout. Any bit pattern whose upper 16 bits are below 0xFFF8 is a Real
+		 * (every NaN is canonicalized to 0x7FF8'0000'0000'0000 when stored), the rest are:
+		 *   0xFFF8'0000'0000'0000  Undefined
+		 *   0xFFF9'0000'0000'000b  Boolean
+		 *   0xFFFA'iiii'iiii'iiii  Integer, 48-bit signed inline payload
+		 *   0xFFFB'pppp'pppp'pppp  Integer out of the inline range, boxed in an IntegerBox
+		 *   0xFFFC'pppp'pppp'pppk  MemoryBlock* (8-byte aligned), k = type() - DataType::String
+		 */
+		static constexpr UInt64 tag_shift = 48;
+		static constexpr UInt64 payload_mask = (UInt64(1) << tag_shift) - 1;
+		static constexpr UInt64 kind_mask = 0x7;
+
+		static constexpr UInt64 tag_undefined = 0xFFF8;
+		static constexpr UInt64 tag_boolean = 0xFFF9;
+		static constexpr UInt64 tag_integer = 0xFFFA;
+		static constexpr UInt64 tag_boxed_integer = 0xFFFB;
+		static constexpr UInt64 tag_block = 0xFFFC;
+
+		static constexpr UInt64 canonical_nan = 0x7FF8'0000'0000'0000;
+
+		static constexpr Integer inline_integer_min = -(Integer(1) << (tag_shift - 1));
+		static constexpr Integer inline_integer_max = (Integer(1) << (tag_shift - 1)) - 1;
+
+		struct IntegerBox
+		{
+			/* Boxes held by frozen blocks are shared between threads and never counted */
+			static constexpr UInt32 immortal = ~UInt32(0);
+
+			UInt32 refs;
+			Integer value;
+
+			inline void retain() { if (refs != immortal) ++refs; }
+			inline void release() { if (refs != immortal && --refs == 0) delete this; }
+		};
+
+		UInt64 _bits;
+#else
 		DataType _type;
 		union {
 			decltype(nullptr) undefined;
 			Integer integer;
 			Real real;
 			Boolean boolean;
-			String* string;
-			Array* array;
-			Object* object;
-			Function* function;
-			Userdata* userdata;
-
-			mem::MemoryBlock* _block;
+			mem::MemoryBlock* block;
 		} _data;
+#endif
+
+	private:
+		inline bool is_block() const;
+		inline mem::MemoryBlock* block() const;
+
+		inline void retain() const;
+		inline void release() const;
+
+		inline void retain_box() const;
+		inline void release_box() const;
+
+		inline void set_undefined();
+		inline void set_integer(Integer value);
+		inline void set_real(Real value);
+		inline void set_boolean(Boolean value);
+		inline void set_block(mem::MemoryBlock* block, DataType type);
+
+		template<typename _Ty>
+		inline Value& assign_block(_Ty* block, DataType type);
+
+		friend class mem::BlockVisitor;
+		friend class mem::SharedRegion;
+		friend class mem::Parcel;
 
 	public:
-		inline Value() : _type{ DataType::Undefined }, _data{ .undefined = nullptr } {}
-		inline Value(const Value& right) : Value()
+		inline Value() { set_undefined(); }
+		inline Value(const Value& right)
 		{
-			_type = right._type;
-			if (!isScalarDataType(right._type))
-				_data._block->inc_ref();
+			raw_copy(*this, right);
+			retain();
 		}
-		inline Value(Value&& right) noexcept : _type{ right._type }, _data{ std::move(right._data) }
+		inline Value(Value&& right) noexcept
 		{
-			right._type = DataType::Undefined;
-			right._data.undefined = nullptr;
+			raw_copy(*this, right);
+			right.set_undefined();
 		}
 		inline ~Value()
 		{
-			if (!isScalarDataType(_type))
-				_data._block->dec_ref();
-			
-			_type = DataType::Undefined;
-			_data.undefined = nullptr;
+			release();
+			set_undefined();
 		}
 
 
@@ -128,12 +248,12 @@ namespace k::data
 		inline Value(decltype(nullptr)) : Value() {}
 		
 		template<std::integral _Ty>
-		inline Value(_Ty data) : _type{ DataType::Integer }, _data{ .integer = static_cast<Integer>(data) } {}
+		inline Value(_Ty data) { set_integer(static_cast<Integer>(data)); }
 
 		template<std::floating_point _Ty>
-		inline Value(_Ty data) : _type{ DataType::Real }, _data{ .real = static_cast<Real>(data) } {}
+		inline Value(_Ty data) { set_real(static_cast<Real>(data)); }
 
-		inline Value(Boolean data) : _type{ DataType::Boolean }, _data{ .boolean = data } {}
+		inline Value(Boolean data) { set_boolean(data); }
 
 		Value(String* data);
 		Value(Array* data);
@@ -153,222 +273,341 @@ namespace k::data
 		/* Copies and Moves */
 		inline Value& operator= (decltype(nullptr))
 		{
-			this->~Value();
+			release();
+			set_undefined();
 			return *this;
 		}
 
 		template<std::integral _Ty>
 		inline Value& operator= (_Ty right)
 		{
-			if (!isScalarDataType(_type))
-				_data._block->dec_ref();
-
-			_type = DataType::Integer;
-			_data.integer = static_cast<Integer>(right);
+			release();
+			set_integer(static_cast<Integer>(right));
 			return *this;
 		}
 
 		template<std::floating_point _Ty>
 		inline Value& operator= (_Ty right)
 		{
-			if (!isScalarDataType(_type))
-				_data._block->dec_ref();
-
-			_type = DataType::Real;
-			_data.real = static_cast<Real>(right);
+			release();
+			set_real(static_cast<Real>(right));
 			return *this;
 		}
 
 		inline Value& operator= (Boolean right)
 		{
-			if (!isScalarDataType(_type))
-				_data._block->dec_ref();
-
-			_type = DataType::Boolean;
-			_data.boolean = right;
+			release();
+			set_boolean(right);
 			return *this;
 		}
 
-		inline Value& operator= (String* right)
-		{
-			if (!isScalarDataType(_type))
-				_data._block->dec_ref();
-
-			_type = right ? DataType::Boolean : DataType::Undefined;
-			_data.string = right;
-			if (right)
-				_data._block->inc_ref();
-			return *this;
-		}
+		Value& operator= (String* right);
 		inline Value& operator= (String& right) { return *this = &right; }
 
-		inline Value& operator= (Array* right)
-		{
-			if (!isScalarDataType(_type))
-				_data._block->dec_ref();
-
-			_type = right ? DataType::Array : DataType::Undefined;
-			_data.array = right;
-			if (right)
-				_data._block->inc_ref();
-			return *this;
-		}
+		Value& operator= (Array* right);
 		inline Value& operator= (Array& right) { return *this = &right; }
 
-		inline Value& operator= (Object* right)
-		{
-			if (!isScalarDataType(_type))
-				_data._block->dec_ref();
-
-			_type = right ? DataType::Object : DataType::Undefined;
-			_data.object = right;
-			if (right)
-				_data._block->inc_ref();
-			return *this;
-		}
+		Value& operator= (Object* right);
 		inline Value& operator= (Object& right) { return *this = &right; }
 
-		inline Value& operator= (Function* right)
-		{
-			if (!isScalarDataType(_type))
-				_data._block->dec_ref();
-
-			_type = right ? DataType::Function : DataType::Undefined;
-			_data.function = right;
-			if (right)
-				_data._block->inc_ref();
-			return *this;
-		}
+		Value& operator= (Function* right);
 		inline Value& operator= (Function& right) { return *this = &right; }
 
-		inline Value& operator= (Userdata* right)
-		{
-			if (!isScalarDataType(_type))
-				_data._block->dec_ref();
-
-			_type = right ? DataType::Userdata : DataType::Undefined;
-			_data.userdata = right;
-			if (right)
-				_data._block->inc_ref();
-			return *this;
-		}
+		Value& operator= (Userdata* right);
 		inline Value& operator= (Userdata& right) { return *this = &right; }
 
 		inline Value& operator= (const Value& right)
 		{
-			if (!isScalarDataType(_type))
-				_data._block->dec_ref();
-
-			_type = right._type;
-			_data = right._data;
-			if (!isScalarDataType(_type))
-				_data._block->inc_ref();
-
+			right.retain();
+			release();
+			raw_copy(*this, right);
 			return *this;
 		}
 
 		inline Value& operator= (Value&& right) noexcept
 		{
-			if (!isScalarDataType(_type))
-				_data._block->dec_ref();
-
-			_type = right._type;
-			_data = std::move(right._data);
-
-			right._type = DataType::Undefined;
-			right._data.undefined = nullptr;
-
+			if (this != &right)
+			{
+				release();
+				raw_copy(*this, right);
+				right.set_undefined();
+			}
 			return *this;
 		}
 
 	public:
-		inline mem::Heap* heap() const
-		{
-			return isScalarDataType(_type) ? nullptr : _data._block->_owner;
-		}
+		inline mem::Heap* heap() const;
 
-		inline DataType type() const { return _type; }
+		/* True for a reference to a block of a SharedRegion */
+		inline bool isFrozen() const;
 
-		inline Integer integer() const { return _data.integer; }
-		inline Real real() const { return _data.real; }
-		inline Boolean boolean() const { return _data.boolean; }
+		inline DataType type() const;
+
+		/* Cheaper than comparing type(), for the interpreter fast paths */
+		inline bool isInteger() const;
+		inline bool isReal() const;
+
+		inline Integer integer() const;
+		inline Real real() const;
+		inline Boolean boolean() const;
 		
-		inline String& string() { return *_data.string; }
-		inline const String& string() const { return *_data.string; }
+		inline String& string();
+		inline const String& string() const;
 
-		inline Array& array() { return *_data.array; }
-		inline const Array& array() const { return *_data.array; }
+		inline Array& array();
+		inline const Array& array() const;
 
-		inline Object& object() { return *_data.object; }
-		inline const Object& object() const { return *_data.object; }
+		inline Object& object();
+		inline const Object& object() const;
 
-		inline Function& function() { return *_data.function; }
-		inline const Function& function() const { return *_data.function; }
+		inline Function& function();
+		inline const Function& function() const;
 
-		inline Userdata& userdata() { return *_data.userdata; }
-		inline const Userdata& userdata() const { return *_data.userdata; }
+		inline Userdata& userdata();
+		inline const Userdata& userdata() const;
 
 		public:
+			/*
+			 * Deferred reference counting (K_DEFERRED_RC): ValueStack slots do not count the blocks
+			 * they refer to. Boxed integers are not MemoryBlocks and stay counted in every slot.
+			 */
+			static inline void copy_uncounted(Value& slot, const Value& value)
+			{
+				value.retain_box();
+				slot.release_box();
+				raw_copy(slot, value);
+			}
+
+			static inline void move_uncounted(Value& slot, Value&& value)
+			{
+				slot.release_box();
+				raw_copy(slot, value);
+				value.set_undefined();
+				if (slot.is_block())
+					slot.block()->dec_ref();
+			}
+
+			static inline void drop_uncounted(Value& slot)
+			{
+				slot.release_box();
+				slot.set_undefined();
+			}
+
 			static inline void swap(Value& left, Value& right)
 			{
-				DataType t_aux = left._type;
-				left._type = right._type;
-				right._type = t_aux;
+				Value aux;
+				raw_copy(aux, left);
+				raw_copy(left, right);
+				raw_copy(right, aux);
+				aux.set_undefined();
+			}
 
-				decltype(left._data) d_aux = std::move(left._data);
-				left._data = std::move(right._data);
-				right._data = std::move(d_aux);
+		private:
+			static inline void raw_copy(Value& dst, const Value& src)
+			{
+#if K_NAN_BOXING
+				dst._bits = src._bits;
+#else
+				dst._type = src._type;
+				dst._data = src._data;
+#endif
 			}
 
 		public:
-			Integer runtime_cast_integer(runtime::RuntimeState& state) const;
-			Real runtime_cast_real(runtime::RuntimeState& state) const;
+			/*
+			 * Script conversions. Undefined is 0, Booleans are 0 or 1 and Reals truncate toward zero; other types, and
+			 * Reals outside of the Integer range, set an error on state, interned in heap, and return 0.
+			 */
+			Integer runtime_cast_integer(runtime::RuntimeState& state, mem::Heap& heap) const;
+			Real runtime_cast_real(runtime::RuntimeState& state, mem::Heap& heap) const;
+
+			/* Every value has one: Undefined and zeros are false, Strings by emptiness, other blocks are true */
 			Boolean runtime_cast_boolean(runtime::RuntimeState& state) const;
 	};
 
+#if K_NAN_BOXING
+	static_assert(sizeof(Value) == sizeof(UInt64), "NaN-boxed Value must be 8 bytes");
+#endif
+
 	
 
-	class String : public mem::MemoryBlock, public std::string
+	/*
+	 * Immutable character sequence in one of three forms:
+	 *   Small  up to small_capacity chars stored inside the block
+	 *   Flat   a separately allocated buffer
+	 *   Rope   the lazy concatenation of two Strings, built by Heap::concat
+	 * A Rope is flattened in place the first time its characters are read (view, indexing, hashing, comparing).
+	 */
+	class String : public mem::MemoryBlock
 	{
 	public:
-		String() = default;
-		virtual ~String() = default;
+		static constexpr bool acyclic = true;
+
+		static constexpr Size small_capacity = 23;
+
+		/* Concatenations shorter than this are copied, a rope node would cost as much as the copy */
+		static constexpr Size rope_min_size = 64;
+
+	private:
+		enum class Form : UInt8 { Small, Flat, Rope };
+
+		struct Rope
+		{
+			Value left;
+			Value right;
+		};
+
+		union Storage
+		{
+			char small[small_capacity + 1];
+			char* flat;
+			Rope rope;
+
+			inline Storage() {}
+			inline ~Storage() {}
+		};
+
+		mutable Form _form;
+		Size _size;
+		Size _hash = 0;
+		mutable Storage _storage;
+
+	public:
+		inline String() : String(std::string_view()) {}
+		virtual ~String();
 
 		String(const String&) = delete;
 		String& operator= (const String&) = delete;
 
 	public:
-		inline String(const char* str) :
-			std::string(str)
-		{}
+		inline explicit String(const char* str) : String(std::string_view(str)) {}
+		inline explicit String(const char* str, Size size) : String(std::string_view(str, size)) {}
+		inline explicit String(const std::string& str) : String(std::string_view(str)) {}
+		explicit String(std::string_view str);
+
+		/* Rope node, both Values must be Strings */
+		String(const Value& left, const Value& right);
+
+	public:
+		inline Size size() const { return _size; }
+		inline Size length() const { return _size; }
+		inline bool empty() const { return _size == 0; }
+
+		inline bool isRope() const { return _form == Form::Rope; }
+		inline bool isSmall() const { return _form == Form::Small; }
+
+		inline const char* data() const
+		{
+			if (_form == Form::Rope)
+				flatten();
+			return _form == Form::Small ? _storage.small : _storage.flat;
+		}
+		inline const char* c_str() const { return data(); }
+
+		inline std::string_view view() const { return std::string_view(data(), _size); }
+		inline operator std::string_view() const { return view(); }
+		inline std::string str() const { return std::string(view()); }
+
+		inline char operator[] (Offset index) const { return data()[index]; }
 
-		inline String(const char* str, Size size) :
-			std::string(str, size)
-		{}
+		/* Interned strings are canonical per Heap */
+		inline bool isInterned() const { return _flags & flag_interned; }
 
-		inline String(const std::string& str) :
-			std::string(str)
-		{}
+		inline Size hash() const { return isInterned() ? _hash : std::hash<std::string_view>()(view()); }
+
+		inline bool operator== (const String& right) const
+		{
+			if (this == &right)
+				return true;
+			if (_size != right._size)
+				return false;
+
+			/* A Heap interns each content once, but Values from other Heaps and frozen ones also meet here */
+			if (isInterned() && right.isInterned() && owner() && owner() == right.owner())
+				return false;
+			return view() == right.view();
+		}
+		inline bool operator== (std::string_view right) const { return view() == right; }
+
+	private:
+		void flatten() const;
+
+		friend class mem::Heap;
+		friend class mem::Parcel;
 	};
 
+	inline std::ostream& operator<< (std::ostream& os, const String& str) { return os << str.view(); }
+
+	/*
+	 * Elements live in one of four backing stores: packed Integer, packed Real, packed Boolean or generic Value.
+	 * An array stays packed while every element it receives has the store's type and becomes generic the first
+	 * time another type is stored. An empty array takes the store of its first element.
+	 */
 	class Array : public mem::MemoryBlock
 	{
+	public:
+		enum class Storage : UInt8 { Integer, Real, Boolean, Generic };
+
+		/* Largest length a script may ask for at once, beyond it NEW_ARRAY_L fails instead of allocating */
+		static constexpr Size max_length = sizeof(void*) == 8 ? Size(1) << 28 : Size(1) << 24;
+
+		/* Reference to one element, reads and writes go through whatever store the array has at that moment */
+		class Element
+		{
+		private:
+			Array* _array;
+			Offset _index;
+
+		public:
+			inline Element(Array& array, Offset index) : _array(&array), _index(index) {}
+
+			inline Element& operator= (const Value& value) { _array->set(_index, value); return *this; }
+			inline Element& operator= (const Element& right) { _array->set(_index, right.value()); return *this; }
+
+			inline Value value() const { return _array->get(_index); }
+			inline operator Value() const { return _array->get(_index); }
+
+			inline DataType type() const { return _array->typeOf(_index); }
+
+			inline Integer integer() const { return _array->_storage == Storage::Integer ? _array->_integers[_index] : value().integer(); }
+			inline Real real() const { return _array->_storage == Storage::Real ? _array->_reals[_index] : value().real(); }
+			inline Boolean boolean() const { return _array->_storage == Storage::Boolean ? _array->_booleans[_index] != 0 : value().boolean(); }
+
+			/* Heap types are only held by generic arrays */
+			inline String& string() const { return _array->_values[_index].string(); }
+			inline Array& array() const { return _array->_values[_index].array(); }
+			inline Object& object() const { return _array->_values[_index].object(); }
+			inline Function& function() const { return _array->_values[_index].function(); }
+			inline Userdata& userdata() const { return _array->_values[_index].userdata(); }
+		};
+
 	private:
-		std::vector<Value> _array;
+		Storage _storage;
 
-	public:
-		using iterator = decltype(_array)::iterator;
-		using const_iterator = decltype(_array)::const_iterator;
+		/*
+		 * A holey array is a generic store of Undefined holes, from Array(Size) or resize, and of elements of one
+		 * packable type. _holes counts the Undefined elements and the array packs once the last one is written.
+		 */
+		bool _holey = false;
+		Size _holes = 0;
+
+		union
+		{
+			std::vector<Integer> _integers;
+			std::vector<Real> _reals;
+			std::vector<UInt8> _booleans;
+			std::vector<Value> _values;
+		};
 
 	public:
-		Array() = default;
-		virtual ~Array() = default;
+		Array();
+		virtual ~Array();
 
 		Array(const Array&) = delete;
 		Array& operator= (const Array&) = delete;
 
 	public:
-		Array(Value* array, Size len);
+		Array(const Value* array, Size len);
 		Array(const std::vector<Value>& vector);
 		Array(std::vector<Value>&& vector) noexcept;
 		Array(std::initializer_list<Value> args);
@@ -376,140 +615,411 @@ namespace k::data
 		explicit Array(Size length);
 
 	public:
-		inline Size length() const { return _array.size(); }
-		inline Size size() const { return _array.size(); }
+		inline Storage storage() const { return _storage; }
+		inline bool isPacked() const { return _storage != Storage::Generic; }
+		inline bool isHoley() const { return _holey; }
+
+		inline Size length() const { return size(); }
+		inline Size size() const
+		{
+			switch (_storage)
+			{
+				case Storage::Integer: return _integers.size();
+				case Storage::Real: return _reals.size();
+				case Storage::Boolean: return _booleans.size();
+				default: return _values.size();
+			}
+		}
+		inline bool empty() const { return size() == 0; }
+
+		inline Value get(Offset index) const
+		{
+			switch (_storage)
+			{
+				case Storage::Integer: return _integers[index];
+				case Storage::Real: return _reals[index];
+				case Storage::Boolean: return _booleans[index] != 0;
+				default: return _values[index];
+			}
+		}
+
+		inline void set(Offset index, const Value& value)
+		{
+			if (!accepts(value))
+				make_generic(value.type() == DataType::Undefined);
 
-		inline bool empty() const { return _array.empty(); }
+			switch (_storage)
+			{
+				case Storage::Integer: _integers[index] = value.integer(); break;
+				case Storage::Real: _reals[index] = value.real(); break;
+				case Storage::Boolean: _booleans[index] = value.boolean(); break;
+				default:
+					if (_holey)
+						set_hole(index, value);
+					else
+						_values[index] = value;
+					break;
+			}
+		}
+
+		DataType typeOf(Offset index) const;
+
+		void resize(Size new_len);
+		void resize(Size new_len, const Value& fill);
+
+		void push_back(const Value& value);
+		void insert(Offset where, const Value& value);
+
+		inline Value front() const { return get(0); }
+		inline Value back() const { return get(size() - 1); }
+
+		void pop_back();
+
+		void erase(Offset where);
+		void erase(Offset first, Offset last);
+
+		void clear();
+
+		/* Moves a generic array whose elements all share a packable type back to a packed store */
+		bool pack();
+
+		/*
+		 * Bulk operations, run by the simd kernels on packed stores and element by element otherwise.
+		 * The numeric ones return false if an element is neither Integer nor Real (Boolean counts for sum).
+		 * Integer results that overflow become Reals, like those of ADD and MUL: a sum is an Integer if its exact
+		 * total fits, and only the overflowed elements of assign_add and assign_mul are Reals.
+		 */
+		bool sum(Value& result) const;
+		bool min(Value& result) const;
+		bool max(Value& result) const;
+
+		/* Elementwise left op right into this array, false if the lengths differ or an element is not numeric */
+		bool assign_add(const Array& left, const Array& right);
+		bool assign_mul(const Array& left, const Array& right);
 
-		inline void resize(Size new_len) { _array.resize(new_len); }
+		/* Copies [first, last) of source, clamped to its length */
+		void assign_slice(const Array& source, Offset first, Offset last);
 
-		inline void push_back(const Value& value) { _array.push_back(value); }
-		inline void push_back(Value&& value) { _array.push_back(std::move(value)); }
+		void fill(const Value& value);
 
-		inline void insert(const_iterator where, const Value& value) { _array.insert(where, value); }
-		inline void insert(const_iterator where, Value&& value) { _array.insert(where, std::move(value)); }
+		/* Offset of the first element equal to value, -1 if none. Equality is by type, then by value */
+		Integer indexOf(const Value& value) const;
+		bool equals(const Array& right) const;
+
+		/* Direct access to a packed store, only valid while storage() matches */
+		inline Integer* integers() { return _integers.data(); }
+		inline const Integer* integers() const { return _integers.data(); }
+		inline Real* reals() { return _reals.data(); }
+		inline const Real* reals() const { return _reals.data(); }
+		inline UInt8* booleans() { return _booleans.data(); }
+		inline const UInt8* booleans() const { return _booleans.data(); }
+		inline Value* values() { return _values.data(); }
+		inline const Value* values() const { return _values.data(); }
+
+		template<typename _Ty>
+		void for_each(_Ty action) const
+		{
+			for (Offset i = 0, len = size(); i < len; ++i)
+				action(get(i));
+		}
+
+	public:
+		inline operator bool() const { return !empty(); }
+		inline bool operator! () const { return empty(); }
+
+		inline Element operator[] (Offset index) { return Element(*this, index); }
+		inline Value operator[] (Offset index) const { return get(index); }
+
+	private:
+		/* Store that can hold value without conversion */
+		static Storage storage_of(const Value& value);
+
+		inline bool accepts(const Value& value) const
+		{
+			switch (_storage)
+			{
+				case Storage::Integer: return value.type() == DataType::Integer;
+				case Storage::Real: return value.type() == DataType::Real;
+				case Storage::Boolean: return value.type() == DataType::Boolean;
+				default: return true;
+			}
+		}
 
-		inline Value& front() { return _array.front(); }
-		inline const Value& front() const { return _array.front(); }
+		template<typename _IntegerOp, typename _RealOp>
+		bool assign_elementwise(const Array& left, const Array& right, _IntegerOp integerOp, _RealOp realOp);
+		template<bool _Max>
+		bool reduce_extreme(Value& result) const;
 
-		inline Value& back() { return _array.back(); }
-		inline const Value& back() const { return _array.back(); }
+		/* Prepares the store for one more element, retyping an empty array and widening a mismatched one */
+		void prepare(const Value& value);
+		void make_generic(bool holey = false);
 
-		inline void pop_back() { _array.pop_back(); }
+		/* Holey bookkeeping: element leaves or enters the generic store, pack_filled packs once no hole is left */
+		inline void forget_hole(const Value& element) { if (element.type() == DataType::Undefined) --_holes; }
+		inline void record_hole(const Value& element)
+		{
+			if (element.type() == DataType::Undefined)
+				++_holes;
+			else if (storage_of(element) == Storage::Generic)
+				_holey = false;
+		}
+		void pack_filled();
+		void set_hole(Offset index, const Value& value);
+		void reset(Storage storage);
 
-		inline void erase(const_iterator where) { _array.erase(where); }
-		inline void erase(const_iterator first, const_iterator last) { _array.erase(first, last); }
+	protected:
+		void traverse(mem::BlockVisitor& visitor) override;
 
-		inline void clear() { _array.clear(); }
+		friend class mem::Parcel;
+	};
 
+	/*
+	 * Hidden class shared by every Object that received the same properties in the same order.
+	 * Shapes form a transition tree rooted at the Heap's empty shape; each one adds one property to its parent.
+	 * A chain of shapes shares one descriptor table, in slot order: a shape sees its first size() entries, and a
+	 * transition from the last shape of a table appends to it instead of copying it.
+	 * Objects with too many properties, or adding one where the tree already branches too much, switch to a
+	 * dictionary shape of their own, outside the tree and never cached.
+	 */
+	class Shape
+	{
 	public:
-		inline operator bool() const { return !_array.empty(); }
-		inline bool operator! () const { return _array.empty(); }
+		struct Slot
+		{
+			Offset index;
+			bool isConst;
+		};
+
+		/* Lookups by String reuse the cached hash of interned names */
+		struct NameHash
+		{
+			using is_transparent = void;
 
-		inline Value& operator[] (Offset index) { return _array[index]; }
-		inline const Value& operator[] (Offset index) const { return _array[index]; }
+			inline Size operator() (std::string_view name) const { return std::hash<std::string_view>()(name); }
+			inline Size operator() (const std::string& name) const { return std::hash<std::string_view>()(name); }
+			inline Size operator() (const String& name) const { return name.hash(); }
+		};
+
+		struct NameEqual
+		{
+			using is_transparent = void;
+
+			inline bool operator() (std::string_view left, std::string_view right) const { return left == right; }
+		};
+
+		static constexpr Size max_properties = 128;
+		static constexpr Size max_transitions = 64;
+
+	private:
+		struct Descriptors
+		{
+			std::vector<std::pair<std::string, Slot>> properties;
+			std::unordered_map<std::string, Offset, NameHash, NameEqual> indices;
+		};
+
+		Shape* _parent = nullptr;
+		Size _size = 0;
+		bool _dictionary = false;
+
+		/* Shapes of frozen Objects are read by several threads at once, they never append to a shared table */
+		bool _concurrent = false;
+
+		std::shared_ptr<Descriptors> _descriptors;
+		std::map<std::pair<std::string, bool>, std::unique_ptr<Shape>> _transitions;
 
 	public:
-		inline iterator begin() { return _array.begin(); }
-		inline const_iterator begin() const { return _array.begin(); }
-		inline const_iterator cbegin() const { return _array.cbegin(); }
-		inline iterator end() { return _array.end(); }
-		inline const_iterator end() const { return _array.end(); }
-		inline const_iterator cend() const { return _array.cend(); }
+		inline explicit Shape(bool concurrent = false) : _concurrent{ concurrent } {}
+		~Shape() = default;
+
+		Shape(const Shape&) = delete;
+		Shape& operator= (const Shape&) = delete;
+
+	public:
+		inline Shape* parent() const { return _parent; }
+		inline Size depth() const { return _size; }
+		inline Size size() const { return _size; }
+		inline bool isDictionary() const { return _dictionary; }
+
+		template<typename _Ty>
+		inline const Slot* find(const _Ty& name) const
+		{
+			if (!_descriptors)
+				return nullptr;
+
+			const auto& it = _descriptors->indices.find(name);
+			return it == _descriptors->indices.end() || it->second >= _size ? nullptr : &_descriptors->properties[it->second].second;
+		}
+
+		/* Returns the child shape that adds the given property, creating it on first use */
+		Shape* transition(const std::string& name, bool isConst);
+
+		/* True when an Object of this shape should become a dictionary rather than add name */
+		inline bool overflows(const std::string& name, bool isConst) const
+		{
+			return _size >= max_properties || (_transitions.size() >= max_transitions && !_transitions.contains({ name, isConst }));
+		}
+
+		/* In slot order, which is the order the properties were added in */
+		template<typename _Fn>
+		void for_each(_Fn&& action) const
+		{
+			for (Offset i = 0; i < _size; ++i)
+				action(_descriptors->properties[i].first, _descriptors->properties[i].second);
+		}
+
+	private:
+		inline Shape(Shape* parent, const std::string& name, bool isConst) :
+			_parent{ parent },
+			_size{ parent->_size + 1 },
+			_concurrent{ parent->_concurrent }
+		{
+			if (parent->_descriptors && !_concurrent && parent->_descriptors->properties.size() == parent->_size)
+				_descriptors = parent->_descriptors;
+			else
+				_descriptors = parent->copy_descriptors();
+			append(name, isConst);
+		}
+
+		std::shared_ptr<Descriptors> copy_descriptors() const;
+		void append(const std::string& name, bool isConst);
+
+		/* Standalone copy of shape for one Object, with every property of shape */
+		static Shape* dictionary(const Shape& shape);
+
+		/* Adds a property to a dictionary shape in place */
+		inline void add(const std::string& name, bool isConst)
+		{
+			append(name, isConst);
+			++_size;
+		}
+
+		friend class Object;
 	};
 
 	class Object : public mem::MemoryBlock
 	{
 	public:
+		/* View of one slot of an Object, empty when the property does not exist */
 		class Property
 		{
 		private:
+			Value* _value = nullptr;
 			bool _const = false;
-			Value _value;
 
 		public:
-			inline Property(const Value& value, bool is_const = false) :
-				_const{ is_const },
-				_value{ value }
-			{}
-			inline Property(Value&& value, bool is_const = false) :
-				_const{ is_const },
-				_value{ std::move(value) }
-			{}
-
 			Property() = default;
 
-			Property(const Property&) = default;
-			Property& operator= (const Property&) noexcept = default;
-
-			~Property() = default;
-
-			Property(Property&&) noexcept = delete;
-			Property& operator= (Property&&) noexcept = delete;
+			inline Property(Value* value, bool is_const) :
+				_value{ value },
+				_const{ is_const }
+			{}
 
 		public:
 			inline bool isConst() const { return _const; }
 
-			inline Value& value() { return _value; }
-			inline const Value& value() const { return _value; }
+			inline Value& value() { return *_value; }
+			inline const Value& value() const { return *_value; }
+
+			inline Value& operator* () { return *_value; }
+			inline const Value& operator* () const { return *_value; }
 
-			inline Value& operator* () { return _value; }
-			inline const Value& operator* () const { return _value; }
+			inline explicit operator bool() const { return _value; }
+			inline bool operator! () const { return !_value; }
 		};
 
 		enum class ConstructType { Parent, Class };
 
 	private:
-		std::unordered_map<std::string, Property> _props;
+		Shape* _shape;
+		std::vector<Value> _slots;
 		Value _parent;
 		Value _class;
 
 	public:
-		using iterator = decltype(_props)::iterator;
-		using const_iterator = decltype(_props)::const_iterator;
-
-	public:
-		Object() = default;
-		~Object() = default;
+		~Object();
 
 		Object(const Object&) = delete;
-		Object& operator= (const Object&) = default;
+		Object& operator= (const Object&) = delete;
 
 	public:
-		Object(const Value& value, ConstructType type);
-		Object(const std::unordered_map<std::string, Property>& props, const Value& value, ConstructType type);
-		Object(const std::unordered_map<std::string, Property>& props);
+		explicit Object(Shape& shape);
+		Object(Shape& shape, const Value& value, ConstructType type);
+
+		Property getProperty(const std::string& name);
+		const Property getProperty(const std::string& name) const;
 
-		Property* getProperty(const std::string& name);
-		const Property* getProperty(const std::string& name) const;
+		Property getProperty(const String& name);
+		const Property getProperty(const String& name) const;
 
 		bool insert(const std::string& name, const Value& value, bool isConst = false);
 
+		/* Appends a property that shape() does not have yet, through a transition or into a dictionary shape */
+		void add_property(const std::string& name, bool isConst, const Value& value);
+
 	public:
-		inline bool empty() const { return _props.empty(); }
-		inline Size size() const { return _props.size(); }
+		inline Shape& shape() const { return *_shape; }
+
+		/* Direct slot access for callers that already resolved the index against shape() */
+		inline Value& slot(Offset index) { return _slots[index]; }
+		inline const Value& slot(Offset index) const { return _slots[index]; }
+
+		/* Appends one slot; next must be the transition of shape() that adds it, see add_property otherwise */
+		inline void add_slot(Shape& next, const Value& value)
+		{
+			_shape = &next;
+			_slots.push_back(value);
+		}
+
+		inline const Value& parent() const { return _parent; }
+		inline const Value& objectClass() const { return _class; }
+
+		inline bool empty() const { return _slots.empty(); }
+		inline Size size() const { return _slots.size(); }
 
 	public:
-		inline operator bool() const { return !_props.empty(); }
-		inline bool operator! () const { return _props.empty(); }
+		inline operator bool() const { return !_slots.empty(); }
+		inline bool operator! () const { return _slots.empty(); }
 
-		inline Value& operator[] (const std::string& name) { return *_props.at(name); }
-		inline const Value& operator[] (const std::string& name) const { return *_props.at(name); }
+		Value& operator[] (const std::string& name);
+		const Value& operator[] (const std::string& name) const;
 
 	public:
-		inline iterator begin() { return _props.begin(); }
-		inline const_iterator begin() const { return _props.begin(); }
-		inline const_iterator cbegin() const { return _props.cbegin(); }
-		inline iterator end() { return _props.end(); }
-		inline const_iterator end() const { return _props.end(); }
-		inline const_iterator cend() const { return _props.cend(); }
+		template<typename _Fn>
+		void for_each(_Fn&& action)
+		{
+			_shape->for_each([this, &action](const std::string& name, const Shape::Slot& slot) {
+				action(name, Property(&_slots[slot.index], slot.isConst));
+			});
+		}
+
+	protected:
+		void traverse(mem::BlockVisitor& visitor) override;
+
+	private:
+		/* Back to root without properties, the slots must already be gone */
+		void reset_shape(Shape& root);
+
+		friend class mem::SharedRegion;
+		friend class mem::Parcel;
 	};
 
+	/*
+	 * Host function called by CALL without a script frame: args holds argsCount values, self is Undefined for a
+	 * plain call. Returns false after setting the state error. See native.h for the typed binding layer.
+	 */
+	typedef bool (*NativeFunction)(runtime::RuntimeState& state, Function& function, const Value& self, const Value* args, Size argsCount, Value& result);
+
 	class Function : public mem::MemoryBlock
 	{
+	public:
+		static constexpr Size native_data_size = 2 * sizeof(void*);
+
 	private:
 		std::string _name;
-		Callable* _callable;
+		Callable* _callable = nullptr;
+
+		NativeFunction _native = nullptr;
+		alignas(void*) Byte _nativeData[native_data_size] = {};
 
 	public:
 		Function() = default;
@@ -519,62 +1029,274 @@ namespace k::data
 
 	public:
 		Function(const Chunk& chunk, Size upsCount, const std::string& name = "");
+
+		/* data is copied inline, at most native_data_size bytes */
+		Function(NativeFunction native, const std::string& name = "", const void* data = nullptr, Size dataSize = 0);
 		~Function();
 
 	public:
 		inline const std::string& name() const { return _name; }
 		inline Callable& callable() { return *_callable; }
 
-		inline Value call(runtime::RuntimeState& state, const Value* args, Size argsCount)
+		inline bool isNative() const { return _native != nullptr; }
+		inline NativeFunction native() const { return _native; }
+		inline const void* nativeData() const { return _nativeData; }
+
+	public:
+		Value call(runtime::RuntimeState& state, const Value* args, Size argsCount);
+		Value call(runtime::RuntimeState& state, std::initializer_list<Value> args);
+		Value call(runtime::RuntimeState& state, const std::vector<Value>& args);
+
+		Value invoke(runtime::RuntimeState& state, const Value& self, const Value* args, Size argsCount);
+		Value invoke(runtime::RuntimeState& state, const Value& self, std::initializer_list<Value> args);
+		Value invoke(runtime::RuntimeState& state, const Value& self, const std::vector<Value>& args);
+
+	protected:
+		void traverse(mem::BlockVisitor& visitor) override;
+	};
+
+	/* Host object stored inline in its block, created by Heap::create_userdata */
+	class Userdata : public mem::MemoryBlock
+	{
+	private:
+		const void* _type;
+
+	protected:
+		inline explicit Userdata(const void* type) : MemoryBlock(), _type(type) {}
+
+	public:
+		/* Identity of a host type, one address per _Ty */
+		template<class _Ty>
+		static inline const void* type_of()
 		{
-			return runtime::execute(state, *_callable, args, argsCount);
+			static const char tag = 0;
+			return &tag;
 		}
 
+		template<class _Ty>
+		inline bool is() const { return _type == type_of<_Ty>(); }
+
+		/* nullptr unless this block holds a _Ty */
+		template<class _Ty>
+		inline _Ty* as();
+	};
+
+	template<class _Ty>
+	class TypedUserdata final : public Userdata
+	{
+	private:
+		_Ty _value;
+
 	public:
-		void call(runtime::RuntimeState& state, std::initializer_list<Value> args);
-		void call(runtime::RuntimeState& state, const std::vector<Value>& args);
+		template<class... _Args>
+		inline explicit TypedUserdata(_Args&&... args) : Userdata(type_of<_Ty>()), _value(std::forward<_Args>(args)...) {}
 
-		void invoke(runtime::RuntimeState& state, const Value& self, const Value* args, Size argsCount);
-		void invoke(runtime::RuntimeState& state, const Value& self, std::initializer_list<Value> args);
-		void invoke(runtime::RuntimeState& state, const Value& self, const std::vector<Value>& args);
+		inline _Ty& value() { return _value; }
+
+	protected:
+		/* A host type holding Values exposes them with a traverse(mem::BlockVisitor&) member */
+		void traverse(mem::BlockVisitor& visitor) override
+		{
+			if constexpr (requires { _value.traverse(visitor); })
+				_value.traverse(visitor);
+		}
 	};
 
-	class Userdata : public mem::MemoryBlock {};
+	template<class _Ty>
+	inline _Ty* Userdata::as() { return is<_Ty>() ? &static_cast<TypedUserdata<_Ty>*>(this)->value() : nullptr; }
 }
 
 
 
 namespace k::data
 {
-	inline Value::Value(String* data) : _type{ data ? DataType::String : DataType::Undefined }, _data{ .string = data }
+#if K_NAN_BOXING
+	inline bool Value::is_block() const { return (_bits >> tag_shift) == tag_block; }
+	inline mem::MemoryBlock* Value::block() const { return reinterpret_cast<mem::MemoryBlock*>(_bits & payload_mask & ~kind_mask); }
+
+	inline void Value::retain() const
 	{
-		if (_data.string)
-			_data.string->inc_ref();
+		if ((_bits >> tag_shift) >= tag_boxed_integer)
+		{
+			if (is_block())
+				block()->inc_ref();
+			else
+				reinterpret_cast<IntegerBox*>(_bits & payload_mask)->retain();
+		}
 	}
 
-	inline Value::Value(Array* data) : _type{ data ? DataType::Array : DataType::Undefined }, _data{ .array = data }
+	inline void Value::release() const
 	{
-		if (_data.array)
-			_data.array->inc_ref();
+		if ((_bits >> tag_shift) >= tag_boxed_integer)
+		{
+			if (is_block())
+				block()->dec_ref();
+			else
+				reinterpret_cast<IntegerBox*>(_bits & payload_mask)->release();
+		}
+	}
+
+	inline void Value::retain_box() const
+	{
+		if ((_bits >> tag_shift) == tag_boxed_integer)
+			reinterpret_cast<IntegerBox*>(_bits & payload_mask)->retain();
 	}
 
-	inline Value::Value(Object* data) : _type{ data ? DataType::Object : DataType::Undefined }, _data{ .object = data }
+	inline void Value::release_box() const
 	{
-		if (_data.object)
-			_data.object->inc_ref();
+		if ((_bits >> tag_shift) == tag_boxed_integer)
+			reinterpret_cast<IntegerBox*>(_bits & payload_mask)->release();
 	}
 
-	inline Value::Value(Function* data) : _type{ data ? DataType::Function : DataType::Undefined }, _data{ .function = data }
+	inline void Value::set_undefined() { _bits = tag_undefined << tag_shift; }
+
+	inline void Value::set_integer(Integer value)
 	{
-		if (_data.function)
-			_data.function->inc_ref();
+		if (value >= inline_integer_min && value <= inline_integer_max)
+			_bits = (tag_integer << tag_shift) | (static_cast<UInt64>(value) & payload_mask);
+		else
+			_bits = (tag_boxed_integer << tag_shift) | reinterpret_cast<UInt64>(new IntegerBox{ 1, value });
 	}
 
-	inline Value::Value(Userdata* data) : _type{ data ? DataType::Userdata : DataType::Undefined }, _data{ .userdata = data }
+	inline void Value::set_real(Real value)
+	{
+		_bits = value != value ? canonical_nan : std::bit_cast<UInt64>(value);
+	}
+
+	inline void Value::set_boolean(Boolean value) { _bits = (tag_boolean << tag_shift) | static_cast<UInt64>(value); }
+
+	inline void Value::set_block(mem::MemoryBlock* block, DataType type)
+	{
+		_bits = (tag_block << tag_shift) | reinterpret_cast<UInt64>(block) | (static_cast<UInt64>(type) - static_cast<UInt64>(DataType::String));
+	}
+
+	inline DataType Value::type() const
+	{
+		switch (_bits >> tag_shift)
+		{
+			case tag_undefined: return DataType::Undefined;
+			case tag_boolean: return DataType::Boolean;
+			case tag_integer:
+			case tag_boxed_integer: return DataType::Integer;
+			case tag_block: return static_cast<DataType>(static_cast<UInt64>(DataType::String) + (_bits & kind_mask));
+			default: return DataType::Real;
+		}
+	}
+
+	inline bool Value::isInteger() const { return ((_bits >> tag_shift) | 0x1) == tag_boxed_integer; }
+	inline bool Value::isReal() const { return (_bits >> tag_shift) < tag_undefined; }
+
+	inline Integer Value::integer() const
 	{
-		if (_data.userdata)
-			_data.userdata->inc_ref();
+		if ((_bits >> tag_shift) == tag_integer)
+			return static_cast<Integer>(_bits << (64 - tag_shift)) >> (64 - tag_shift);
+		return reinterpret_cast<const IntegerBox*>(_bits & payload_mask)->value;
 	}
+
+	inline Real Value::real() const { return std::bit_cast<Real>(_bits); }
+	inline Boolean Value::boolean() const { return (_bits & 0x1) != 0; }
+#else
+	inline bool Value::is_block() const { return !isScalarDataType(_type); }
+	inline mem::MemoryBlock* Value::block() const { return _data.block; }
+
+	inline void Value::retain() const
+	{
+		if (is_block())
+			_data.block->inc_ref();
+	}
+
+	inline void Value::release() const
+	{
+		if (is_block())
+			_data.block->dec_ref();
+	}
+
+	inline void Value::retain_box() const {}
+	inline void Value::release_box() const {}
+
+	inline void Value::set_undefined()
+	{
+		_type = DataType::Undefined;
+		_data.undefined = nullptr;
+	}
+
+	inline void Value::set_integer(Integer value)
+	{
+		_type = DataType::Integer;
+		_data.integer = value;
+	}
+
+	inline void Value::set_real(Real value)
+	{
+		_type = DataType::Real;
+		_data.real = value;
+	}
+
+	inline void Value::set_boolean(Boolean value)
+	{
+		_type = DataType::Boolean;
+		_data.boolean = value;
+	}
+
+	inline void Value::set_block(mem::MemoryBlock* block, DataType type)
+	{
+		_type = type;
+		_data.block = block;
+	}
+
+	inline DataType Value::type() const { return _type; }
+
+	inline bool Value::isInteger() const { return _type == DataType::Integer; }
+	inline bool Value::isReal() const { return _type == DataType::Real; }
+
+	inline Integer Value::integer() const { return _data.integer; }
+	inline Real Value::real() const { return _data.real; }
+	inline Boolean Value::boolean() const { return _data.boolean; }
+#endif
+
+	template<typename _Ty>
+	inline Value& Value::assign_block(_Ty* block, DataType type)
+	{
+		if (block)
+			block->inc_ref();
+		release();
+
+		if (block)
+			set_block(block, type);
+		else
+			set_undefined();
+		return *this;
+	}
+
+	inline Value::Value(String* data) { set_undefined(), assign_block(data, DataType::String); }
+	inline Value::Value(Array* data) { set_undefined(), assign_block(data, DataType::Array); }
+	inline Value::Value(Object* data) { set_undefined(), assign_block(data, DataType::Object); }
+	inline Value::Value(Function* data) { set_undefined(), assign_block(data, DataType::Function); }
+	inline Value::Value(Userdata* data) { set_undefined(), assign_block(data, DataType::Userdata); }
+
+	inline Value& Value::operator= (String* right) { return assign_block(right, DataType::String); }
+	inline Value& Value::operator= (Array* right) { return assign_block(right, DataType::Array); }
+	inline Value& Value::operator= (Object* right) { return assign_block(right, DataType::Object); }
+	inline Value& Value::operator= (Function* right) { return assign_block(right, DataType::Function); }
+	inline Value& Value::operator= (Userdata* right) { return assign_block(right, DataType::Userdata); }
+
+	inline mem::Heap* Value::heap() const { return is_block() ? block()->_owner : nullptr; }
+	inline bool Value::isFrozen() const { return is_block() && block()->isFrozen(); }
+
+	inline String& Value::string() { return *static_cast<String*>(block()); }
+	inline const String& Value::string() const { return *static_cast<const String*>(block()); }
+
+	inline Array& Value::array() { return *static_cast<Array*>(block()); }
+	inline const Array& Value::array() const { return *static_cast<const Array*>(block()); }
+
+	inline Object& Value::object() { return *static_cast<Object*>(block()); }
+	inline const Object& Value::object() const { return *static_cast<const Object*>(block()); }
+
+	inline Function& Value::function() { return *static_cast<Function*>(block()); }
+	inline const Function& Value::function() const { return *static_cast<const Function*>(block()); }
+
+	inline Userdata& Value::userdata() { return *static_cast<Userdata*>(block()); }
+	inline const Userdata& Value::userdata() const { return *static_cast<const Userdata*>(block()); }
 }
 
 
@@ -582,18 +1304,63 @@ namespace k::data
 
 namespace k::mem
 {
+	inline void BlockVisitor::operator() (const data::Value& value)
+	{
+		if (value.is_block())
+			visit(value.block());
+	}
+
+	struct CycleCollectorStats
+	{
+		Size collections = 0;
+		Size freedBlocks = 0;
+		std::chrono::nanoseconds lastPause{ 0 };
+		std::chrono::nanoseconds maxPause{ 0 };
+		std::chrono::nanoseconds totalPause{ 0 };
+	};
+
 	class Heap
 	{
+	public:
+		static constexpr Size default_cycle_threshold = 16384;
+		static constexpr Size default_roots_limit = 8192;
+		static constexpr Size default_zct_threshold = 4096;
+
 	private:
 		MemoryBlock* _front;
 		MemoryBlock* _back;
 
+		SlabAllocator _slabs;
+
+		std::vector<MemoryBlock*> _roots;
+		std::vector<MemoryBlock*> _scratch;
+		Size _cycleThreshold = default_cycle_threshold;
+		Size _allocationsSinceCollect = 0;
+		Size _rootsLimit = default_roots_limit;
+		Size _rootsTrigger = default_roots_limit;
+		CycleCollectorStats _cycleStats;
+
+		std::vector<RootSet*> _rootSets;
+
+		/* Root of the shape tree, every new Object starts with no properties */
+		data::Shape _rootShape;
+
+		/* Weak table: an interned String leaves it when its block is released */
+		std::unordered_map<std::string_view, data::String*> _interned;
+
+#if K_DEFERRED_RC
+		std::vector<MemoryBlock*> _zct;
+		Size _zctThreshold = default_zct_threshold;
+		bool _rootsPinned = false;
+#endif
+
 	public:
 		Heap();
 		~Heap();
 
-		Heap(Heap&&) noexcept = default;
-		Heap& operator= (Heap&&) noexcept = default;
+		/* Blocks point back to their Heap through _owner, so a Heap cannot be relocated */
+		Heap(Heap&&) noexcept = delete;
+		Heap& operator= (Heap&&) noexcept = delete;
 
 		Heap(const Heap&) = delete;
 		Heap& operator= (const Heap&) = delete;
@@ -601,13 +1368,121 @@ namespace k::mem
 	public:
 		void deallocate(MemoryBlock* block);
 
+		inline Size pageCount() const { return _slabs.pageCount(); }
+
+	public:
+		/* Runs a synchronous trial-deletion pass over the blocks buffered as possible cycle roots */
+		void collect_cycles();
+
+		/* Number of allocations between automatic cycle collections, 0 disables them */
+		inline void setCycleCollectionThreshold(Size allocations) { _cycleThreshold = allocations; }
+		inline Size cycleCollectionThreshold() const { return _cycleThreshold; }
+
+		/*
+		 * Size of the possible roots buffer that starts a collection on the next allocation, whatever the allocation
+		 * count. With automatic collections disabled it only frees the buffered blocks whose count dropped to zero.
+		 */
+		inline void setCycleRootsLimit(Size blocks) { _rootsLimit = _rootsTrigger = std::max<Size>(blocks, 1); }
+		inline Size cycleRootsLimit() const { return _rootsLimit; }
+
+		inline const CycleCollectorStats& cycleCollectorStats() const { return _cycleStats; }
+
+	public:
+		void attach(RootSet& roots);
+		void detach(RootSet& roots);
+
+#if K_DEFERRED_RC
+		/* Frees every zero-count block that no attached root set refers to */
+		void reconcile();
+
+		/* Zero-count table size that triggers a reconcile on the next allocation */
+		inline void setZeroCountThreshold(Size blocks) { _zctThreshold = blocks; }
+		inline Size zeroCountThreshold() const { return _zctThreshold; }
+#endif
+
+	private:
+		inline void possible_root(MemoryBlock* block)
+		{
+			block->_color = MemoryBlock::Color::Purple;
+			if (!(block->_flags & MemoryBlock::flag_buffered))
+			{
+				block->_flags |= MemoryBlock::flag_buffered;
+				_roots.push_back(block);
+			}
+		}
+
+		/* A buffered block whose count dropped to zero waits for the next drain, unless it is the newest entry */
+		inline void zero_buffered(MemoryBlock* block)
+		{
+			if (!_roots.empty() && _roots.back() == block)
+			{
+				_roots.pop_back();
+				block->_flags &= ~MemoryBlock::flag_buffered;
+				deallocate(block);
+			}
+		}
+
+		void drain_roots(std::vector<MemoryBlock*>& candidates);
+		void purge_roots();
+
+		template<typename _Ty>
+		void for_each_child(MemoryBlock* block, _Ty&& action);
+
+		void mark_gray(MemoryBlock* block);
+		void scan(MemoryBlock* block);
+		void scan_black(MemoryBlock* block);
+		void collect_white(MemoryBlock* block, std::vector<MemoryBlock*>& garbage);
+		void unlink(MemoryBlock* block);
+
+		void mark_roots(UInt8 flag);
+		void unmark_roots(UInt8 flag);
+
+#if K_DEFERRED_RC
+		inline void zero_count(MemoryBlock* block)
+		{
+			block->_flags |= MemoryBlock::flag_zct;
+			_zct.push_back(block);
+		}
+
+		void pin_roots();
+		void unpin_roots();
+		void unpin(RootSet& roots);
+#endif
+
+		friend class MemoryBlock;
+		friend class Parcel;
+
 	private:
 		template<std::derived_from<MemoryBlock> _Ty, typename... _Args>
 		_Ty* allocate(_Args&&... args)
 		{
-			_Ty* block = utils::malloc<_Ty>(std::max(sizeof(_Ty), sizeof(MemoryBlock)));
+#if K_DEFERRED_RC
+			if (_zct.size() >= _zctThreshold)
+				reconcile();
+#endif
+			if (_cycleThreshold > 0 && ++_allocationsSinceCollect >= _cycleThreshold)
+				collect_cycles();
+			else if (_roots.size() >= _rootsTrigger)
+			{
+				if (_cycleThreshold > 0)
+					collect_cycles();
+				else
+					purge_roots();
+			}
+
+			constexpr UInt8 sizeClass = SlabAllocator::size_class(std::max(sizeof(_Ty), sizeof(MemoryBlock)));
+			static_assert(alignof(_Ty) <= SlabAllocator::granularity, "MemoryBlock types must fit the slab slot alignment");
+
+			_Ty* block;
+			if constexpr (sizeClass == SlabAllocator::large_class)
+				block = utils::malloc<_Ty>(sizeof(_Ty));
+			else
+				block = reinterpret_cast<_Ty*>(_slabs.allocate(sizeClass));
 			utils::construct<_Ty>(*block, std::forward<_Args>(args)...);
 
+			block->_sizeClass = sizeClass;
+			if constexpr (_Ty::acyclic)
+				block->_flags = MemoryBlock::flag_acyclic;
 			block->_owner = this;
 			block->_next = nullptr;
 			block->_prev = _back;
@@ -624,15 +1499,36 @@ namespace k::mem
 			return block;
 		}
 
+		void release(MemoryBlock* block);
+
 	public:
 		inline data::Value create_string() { return allocate<data::String>(); }
 		data::Value create_string(const char* str) { return allocate<data::String>(str); }
 		data::Value create_string(const std::string& str) { return allocate<data::String>(str); }
+		data::Value create_string(std::string_view str) { return allocate<data::String>(str); }
+
+		/* left + right, both must be Strings. Long results are built as a lazy rope */
+		data::Value concat(const data::Value& left, const data::Value& right);
+
+		/* Returns the canonical String of this Heap for the given contents, creating it if needed */
+		data::Value intern(std::string_view str);
+		inline Size internedCount() const { return _interned.size(); }
+
+		inline data::Shape& rootShape() { return _rootShape; }
+
+		inline data::Value create_object() { return allocate<data::Object>(_rootShape); }
+		inline data::Value create_object(const data::Value& value, data::Object::ConstructType type) { return allocate<data::Object>(_rootShape, value, type); }
+
+		inline data::Value create_function(const Chunk& chunk, Size upsCount = 0, const std::string& name = "") { return allocate<data::Function>(chunk, upsCount, name); }
+		inline data::Value create_function(data::NativeFunction native, const std::string& name = "", const void* data = nullptr, Size dataSize = 0) { return allocate<data::Function>(native, name, data, dataSize); }
+
+		template<class _Ty, class... _Args>
+		inline data::Value create_userdata(_Args&&... args) { return static_cast<data::Userdata*>(allocate<data::TypedUserdata<_Ty>>(std::forward<_Args>(args)...)); }
 
 		inline data::Value create_array() { return allocate<data::Array>(); }
 		inline data::Value create_array(Size len) { return allocate<data::Array>(len); }
 		inline data::Value create_array(Size len, const data::Value& default_value) { return allocate<data::Array>(len, default_value); }
-		inline data::Value create_array(data::Value* array, Size len) { return allocate<data::Array>(array, len); }
+		inline data::Value create_array(const data::Value* array, Size len) { return allocate<data::Array>(array, len); }
 		inline data::Value create_array(const std::vector<data::Value>& vector) { return allocate<data::Array>(vector); }
 		inline data::Value create_array(std::vector<data::Value>&& vector) { return allocate<data::Array>(std::move(vector)); }
 		inline data::Value create_array(std::initializer_list<data::Value> args) { return allocate<data::Array>(args); }
@@ -641,10 +1537,30 @@ namespace k::mem
 
 	inline void MemoryBlock::dec_ref()
 	{
+		if (_flags & flag_frozen)
+			return;
+
 		if (_refs > 0)
 			--_refs;
-		
-		if(_refs == 0 && _owner)
-			_owner->deallocate(this);
+
+		if (!_owner)
+			return;
+
+		if (_refs == 0)
+		{
+#if K_DEFERRED_RC
+			/* Stack slots may still refer to it, Heap::reconcile decides */
+			if (!(_flags & flag_zct))
+				_owner->zero_count(this);
+#else
+			/* A buffered block is freed when the roots buffer is drained; flag_zct marks the garbage of a collection */
+			if (!(_flags & flag_buffered))
+				_owner->deallocate(this);
+			else if (!(_flags & flag_zct))
+				_owner->zero_buffered(this);
+#endif
+		}
+		else if (!(_flags & flag_acyclic))
+			_owner->possible_root(this);
 	}
 }
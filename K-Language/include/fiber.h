@@ -0,0 +1,49 @@
+#pragma once
+
+#include "runtime.h"
+
+namespace k::runtime
+{
+	/*
+	 * Script coroutine with a RuntimeState of its own, whose value and call stacks start small and grow on demand.
+	 * YIELD parks the interpreter registers in that state and resume re-enters the interpreter from them, so a
+	 * switch is a handful of pointer loads and stores on the host thread, no OS thread or native stack involved.
+	 * Fibers live in a Heap as TypedUserdata<Fiber>, see create.
+	 */
+	class Fiber
+	{
+	public:
+		enum class Status : UInt8 { Created, Suspended, Running, Dead };
+
+		static constexpr Size default_value_count = Size(1) << 15;
+		static constexpr Size default_value_capacity = sizeof(data::Value) * default_value_count;
+
+	private:
+		RuntimeState _state;
+		data::Value _function;
+		Status _status;
+
+	public:
+		explicit Fiber(data::Function& function, Size valueCapacity = default_value_capacity);
+
+		Fiber(const Fiber&) = delete;
+		Fiber& operator= (const Fiber&) = delete;
+
+		inline Status status() const { return _status; }
+		inline bool isDead() const { return _status == Status::Dead; }
+		inline data::Function& function() const { return const_cast<data::Value&>(_function).function(); }
+
+		/*
+		 * Runs the fiber until it yields or returns, and gives back that value. The first resume passes args to the
+		 * function, later ones pass args[0] (undefined if there is none) as the result of the pending YIELD.
+		 * An error raised in the fiber kills it and is moved to caller.
+		 */
+		data::Value resume(RuntimeState& caller, const data::Value* args, Size argsCount);
+		data::Value resume(RuntimeState& caller, std::initializer_list<data::Value> args);
+
+		void traverse(mem::BlockVisitor& visitor);
+
+	public:
+		static data::Value create(mem::Heap& heap, data::Function& function, Size valueCapacity = default_value_capacity);
+	};
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "chunk.h"
+#include "mapped_file.h"
+
+namespace k::image
+{
+	/*
+	 * Binary chunk tree, native little-endian layout with every section and every code block 8-byte aligned:
+	 *   Header | ChunkRecord[chunkCount] | ConstantRecord[constantCount] | string bytes | code
+	 * Record 0 is the root chunk and the children of a chunk are the contiguous records following it.
+	 * Code is stored optimized and with its property cache operands numbered, so it runs straight from the mapping.
+	 */
+	constexpr char magic[4] = { 'K', 'B', 'C', 'I' };
+	constexpr UInt32 version = 8;		/* Bumped whenever opcode numbering changes */
+	constexpr UInt32 byte_order_mark = 0x01020304;
+	constexpr Size alignment = 8;
+
+	struct Header
+	{
+		char magic[4];
+		UInt32 version;
+		UInt32 byteOrder;
+		UInt32 chunkCount;
+		UInt64 constantCount;
+		UInt64 chunksOffset;
+		UInt64 constantsOffset;
+		UInt64 stringsOffset;
+		UInt64 codeOffset;
+		UInt64 fileSize;
+	};
+
+	struct ChunkRecord
+	{
+		UInt32 firstChild;
+		UInt32 childCount;
+		UInt64 firstConstant;
+		UInt32 constantCount;
+		UInt32 varsCount;
+		UInt32 tempsCount;
+		UInt32 propertyCachesCount;
+		UInt64 codeOffset;		/* Relative to Header::codeOffset */
+		UInt64 codeSize;
+	};
+
+	struct ConstantRecord
+	{
+		UInt32 type;			/* Chunk::Constant::Type */
+		UInt32 stringSize;
+		union
+		{
+			data::Integer integer;
+			data::Real real;
+			UInt64 boolean;
+			UInt64 stringOffset;	/* Relative to Header::stringsOffset */
+		};
+	};
+
+	static_assert(sizeof(Header) % alignment == 0 && sizeof(ChunkRecord) % alignment == 0 && sizeof(ConstantRecord) % alignment == 0);
+
+	/* Serializes a chunk tree, throws error::BytecodeError for constants with no image representation */
+	void write(std::ostream& out, const Chunk& root);
+
+	/* A chunk tree running in place over a mapped image file. Constants are built the first time a chunk is instantiated */
+	class MappedImage
+	{
+	private:
+		utils::MappedFile _file;
+		Chunk _root;
+
+	public:
+		MappedImage() = default;
+		~MappedImage() = default;
+
+		MappedImage(const MappedImage&) = delete;
+		MappedImage& operator= (const MappedImage&) = delete;
+
+	public:
+		/* Throws error::RuntimeError if the file cannot be mapped and error::BytecodeError if it is malformed */
+		void load(const std::string& path, mem::Heap& heap, bool verify = true);
+
+		inline bool isLoaded() const { return _file.isOpen(); }
+		inline const Chunk& root() const { return _root; }
+
+	private:
+		/* Rejects records that do not form one tree rooted at record 0, each record the child of exactly one chunk */
+		void check_tree(const Header& header) const;
+
+		/*
+		 * Builds one chunk from its record and allocates its children, load builds them next.
+		 * Chunks with the same constant range as their parent share its pool.
+		 */
+		void build(Chunk& chunk, UInt32 index, const Chunk* parent, mem::Heap& heap, bool verify);
+	};
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "data.h"
+
+namespace k::runtime
+{
+	/*
+	 * Inline cache of one property access instruction. Entries are keyed by the receiver's Shape:
+	 * monomorphic with one entry, polymorphic up to max_entries, then megamorphic (always misses).
+	 */
+	class PropertyCache
+	{
+	public:
+		static constexpr Size max_entries = 4;
+
+		enum class State : UInt8 { Uninitialized, Monomorphic, Polymorphic, Megamorphic };
+
+	private:
+		struct Entry
+		{
+			const data::Shape* shape;
+			const data::Object* holder;		/* Loads: _parent holding the slot, nullptr for own slots */
+			const data::Shape* target;		/* Loads: holder's shape. Stores: shape after adding the slot, nullptr for own slots */
+			Offset index;
+		};
+
+		Entry _entries[max_entries];
+		UInt8 _count = 0;
+		bool _megamorphic = false;
+
+	public:
+		PropertyCache() = default;
+
+		PropertyCache(const PropertyCache&) = delete;
+		PropertyCache& operator= (const PropertyCache&) = delete;
+
+	public:
+		inline State state() const
+		{
+			if (_megamorphic)
+				return State::Megamorphic;
+			return _count == 0 ? State::Uninitialized : _count == 1 ? State::Monomorphic : State::Polymorphic;
+		}
+
+		inline void reset() { _count = 0, _megamorphic = false; }
+
+		/* Cached load: the slot holding the property, or nullptr when the cache misses */
+		inline const data::Value* load(const data::Object& object) const
+		{
+			const data::Shape* shape = &object.shape();
+			for (Offset i = 0; i < _count; ++i)
+			{
+				const Entry& entry = _entries[i];
+				if (entry.shape != shape)
+					continue;
+
+				if (!entry.holder)
+					return &object.slot(entry.index);
+
+				const data::Value& parent = object.parent();
+				if (parent.type() == data::DataType::Object && &parent.object() == entry.holder && &entry.holder->shape() == entry.target)
+					return &entry.holder->slot(entry.index);
+			}
+			return nullptr;
+		}
+
+		/* Cached store: false when the cache misses */
+		inline bool store(data::Object& object, const data::Value& value) const
+		{
+			const data::Shape* shape = &object.shape();
+			for (Offset i = 0; i < _count; ++i)
+			{
+				const Entry& entry = _entries[i];
+				if (entry.shape != shape)
+					continue;
+
+				if (entry.target)
+					object.add_slot(*const_cast<data::Shape*>(entry.target), value);
+				else
+					object.slot(entry.index) = value;
+				return true;
+			}
+			return false;
+		}
+
+		/* Uncached load through the _parent chain; own and first-parent hits are cached. nullptr if undefined */
+		const data::Value* lookup(const data::Object& object, const data::String& name);
+
+		/* Uncached store, adding an own property if missing. Returns false if the property is const */
+		bool update(data::Object& object, const data::String& name, const data::Value& value);
+
+	private:
+		void add(const data::Shape* shape, const data::Object* holder, const data::Shape* target, Offset index);
+	};
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "native.h"
+
+namespace k::runtime
+{
+	/*
+	 * Heap independent description of a chunk tree. Blocks and counts are never shared between threads, so every
+	 * Isolate builds a Chunk of its own from the Program the first time it runs it.
+	 */
+	class Program
+	{
+	private:
+		UInt64 _id;
+		/* Shared by the copies of the Program, the Isolates watch it to drop their Chunk once all are gone */
+		std::shared_ptr<const bool> _alive;
+		std::vector<instruction::InstructionValue> _code;
+		Size _varsCount;
+		std::vector<Chunk::Constant> _constants;
+		std::vector<Program> _children;
+
+	public:
+		Program(
+			std::vector<instruction::InstructionValue> code,
+			Size varsCount,
+			std::vector<Chunk::Constant> constants = {},
+			std::vector<Program> children = {}
+		);
+
+		/* Unique per Program, the key of the per Isolate Chunk caches */
+		inline UInt64 id() const { return _id; }
+		inline std::weak_ptr<const bool> lifetime() const { return _alive; }
+
+		/* Throws error::BytecodeError as the Chunk constructor does */
+		Chunk build(mem::Heap& heap) const;
+	};
+
+	/*
+	 * One Heap and one RuntimeState, used by a single thread at a time. Scripts only see the Values of their own
+	 * Isolate, anything crossing Isolates goes through host types.
+	 */
+	class Isolate
+	{
+	public:
+		/* Cache size at which function first drops the Chunks of dead Programs, the bound then doubles */
+		static constexpr Size min_prune_size = 16;
+
+	private:
+		struct Instance
+		{
+			std::unique_ptr<Chunk> chunk;
+			data::Value function;
+			std::weak_ptr<const bool> program;
+		};
+
+		mem::Heap _heap;
+		RuntimeState _state;
+
+		/* Declared after the Heap, the Chunks must be released before it */
+		std::unordered_map<UInt64, Instance> _programs;
+		Size _pruneAt = min_prune_size;
+
+	public:
+		Isolate() = default;
+
+		Isolate(const Isolate&) = delete;
+		Isolate& operator= (const Isolate&) = delete;
+
+		inline mem::Heap& heap() { return _heap; }
+		inline RuntimeState& state() { return _state; }
+
+		/* Function running program in this Isolate, built on first use */
+		data::Function& function(const Program& program);
+
+		/* Releases the Chunks of the Programs destroyed since, function does it as the cache grows */
+		void prune();
+
+		/*
+		 * Calls program with args boxed as native bindings box their results, and unboxes the result as a native
+		 * parameter of type _Ret. Only types that do not refer to the Heap can leave the Isolate: numbers, bool,
+		 * std::string or void. A script error is thrown as error::RuntimeError.
+		 */
+		template<class _Ret, class... _Args>
+		_Ret invoke(const Program& program, const _Args&... args)
+		{
+			static_assert(std::is_void_v<_Ret> || std::is_arithmetic_v<_Ret> || std::is_same_v<_Ret, std::string>,
+				"an Isolate result must not refer to its Heap");
+
+			data::Value arguments[] = { native::to_value(_heap, args)..., data::Value() };
+			data::Value result = function(program).call(_state, arguments, sizeof...(_Args));
+			if (_state.hasError())
+				raise();
+
+			if constexpr (!std::is_void_v<_Ret>)
+			{
+				if (!native::Argument<_Ret>::check(result))
+					throw error::RuntimeError("unexpected type of script result");
+				return native::Argument<_Ret>::get(result);
+			}
+		}
+
+	private:
+		/* Clears the state error and throws it */
+		[[noreturn]] void raise();
+	};
+}
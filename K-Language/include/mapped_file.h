@@ -0,0 +1,40 @@
+#pragma once
+
+#include "common.h"
+
+namespace k::utils
+{
+	/* Read-only memory mapping of a whole file */
+	class MappedFile
+	{
+	private:
+		const Byte* _data = nullptr;
+		Size _size = 0;
+
+#if defined(_WIN32)
+		void* _file = nullptr;
+		void* _mapping = nullptr;
+#else
+		int _fd = -1;
+#endif
+
+	public:
+		MappedFile() = default;
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator= (const MappedFile&) = delete;
+
+		MappedFile(MappedFile&& right) noexcept;
+		MappedFile& operator= (MappedFile&& right) noexcept;
+
+	public:
+		bool open(const std::string& path);
+		void close();
+
+		inline bool isOpen() const { return _data != nullptr; }
+
+		inline const Byte* data() const { return _data; }
+		inline Size size() const { return _size; }
+	};
+}
@@ -0,0 +1,259 @@
+#pragma once
+
+#include "runtime.h"
+
+namespace k::native
+{
+	/*
+	 * Binding of C++ functions as native K Functions. The unboxing of every parameter and the boxing of the result
+	 * are generated per bound function, the call itself is a direct call the compiler can inline.
+	 *   native::bind<&f>(heap, "f")              free function, or member function called on a Userdata self
+	 *   native::bind(heap, functor, "f")         small trivially copyable functor stored inline in the Function
+	 * A leading runtime::RuntimeState& parameter receives the state, a function raising an error through it fails
+	 * the call. Missing arguments are Undefined, extra arguments are ignored.
+	 */
+
+	/* Unboxing of a parameter type: check tells whether a Value converts, get converts it */
+	template<class _Ty>
+	struct Argument
+	{
+		static_assert(sizeof(_Ty) == 0, "unsupported native parameter type");
+	};
+
+	template<class _Ty> requires std::integral<_Ty> && (!std::same_as<_Ty, bool>)
+	struct Argument<_Ty>
+	{
+		static inline bool check(const data::Value& value) { return value.isInteger(); }
+		static inline _Ty get(const data::Value& value) { return static_cast<_Ty>(value.integer()); }
+	};
+
+	template<std::floating_point _Ty>
+	struct Argument<_Ty>
+	{
+		static inline bool check(const data::Value& value) { return value.isReal() || value.isInteger(); }
+		static inline _Ty get(const data::Value& value) { return static_cast<_Ty>(value.isReal() ? value.real() : static_cast<data::Real>(value.integer())); }
+	};
+
+	template<>
+	struct Argument<bool>
+	{
+		static inline bool check(const data::Value& value) { return value.type() == data::DataType::Boolean; }
+		static inline bool get(const data::Value& value) { return value.boolean(); }
+	};
+
+	template<>
+	struct Argument<std::string_view>
+	{
+		static inline bool check(const data::Value& value) { return value.type() == data::DataType::String; }
+		static inline std::string_view get(const data::Value& value) { return value.string().view(); }
+	};
+
+	template<>
+	struct Argument<std::string>
+	{
+		static inline bool check(const data::Value& value) { return value.type() == data::DataType::String; }
+		static inline std::string get(const data::Value& value) { return value.string().str(); }
+	};
+
+	template<>
+	struct Argument<data::Value>
+	{
+		static inline bool check(const data::Value&) { return true; }
+		static inline const data::Value& get(const data::Value& value) { return value; }
+	};
+
+	template<>
+	struct Argument<data::Array>
+	{
+		static inline bool check(const data::Value& value) { return value.type() == data::DataType::Array; }
+		static inline data::Array& get(const data::Value& value) { return const_cast<data::Array&>(value.array()); }
+	};
+
+	template<>
+	struct Argument<data::Object>
+	{
+		static inline bool check(const data::Value& value) { return value.type() == data::DataType::Object; }
+		static inline data::Object& get(const data::Value& value) { return const_cast<data::Object&>(value.object()); }
+	};
+
+	template<>
+	struct Argument<data::Function>
+	{
+		static inline bool check(const data::Value& value) { return value.type() == data::DataType::Function; }
+		static inline data::Function& get(const data::Value& value) { return const_cast<data::Function&>(value.function()); }
+	};
+
+	/* Host types are taken from a Userdata of that type, by reference or by pointer. A pointer also accepts Undefined */
+	template<class _Ty>
+	inline _Ty* userdata_of(const data::Value& value)
+	{
+		return value.type() == data::DataType::Userdata ? const_cast<data::Userdata&>(value.userdata()).as<_Ty>() : nullptr;
+	}
+
+	template<class _Ty> requires std::is_class_v<_Ty>
+	struct Argument<_Ty>
+	{
+		static inline bool check(const data::Value& value) { return userdata_of<_Ty>(value) != nullptr; }
+		static inline _Ty& get(const data::Value& value) { return *userdata_of<_Ty>(value); }
+	};
+
+	template<class _Ty> requires std::is_class_v<_Ty>
+	struct Argument<_Ty*>
+	{
+		static inline bool check(const data::Value& value) { return value.type() == data::DataType::Undefined || userdata_of<_Ty>(value) != nullptr; }
+		static inline _Ty* get(const data::Value& value) { return userdata_of<_Ty>(value); }
+	};
+
+
+	template<class _Ty>
+	inline data::Value to_value(mem::Heap& heap, _Ty&& value)
+	{
+		using Type = std::remove_cvref_t<_Ty>;
+		if constexpr (std::is_same_v<Type, data::Value>)
+			return std::forward<_Ty>(value);
+		else if constexpr (std::is_same_v<Type, bool>)
+			return data::Value(static_cast<data::Boolean>(value));
+		else if constexpr (std::is_integral_v<Type>)
+			return data::Value(static_cast<data::Integer>(value));
+		else if constexpr (std::is_floating_point_v<Type>)
+			return data::Value(static_cast<data::Real>(value));
+		else if constexpr (std::is_convertible_v<_Ty, std::string_view>)
+			return heap.create_string(std::string_view(value));
+		else
+			static_assert(sizeof(_Ty) == 0, "unsupported native return type");
+	}
+
+
+	/* Cold paths of the generated bindings, they set the state error and return false */
+	bool argument_error(runtime::RuntimeState& state, data::Function& function, Size index);
+	bool self_error(runtime::RuntimeState& state, data::Function& function);
+
+	template<class _Ty>
+	constexpr bool is_state = std::is_same_v<_Ty, runtime::RuntimeState&>;
+
+	template<class... _Params>
+	constexpr bool leading_state = false;
+
+	template<class _Head, class... _Tail>
+	constexpr bool leading_state<_Head, _Tail...> = is_state<_Head>;
+
+	template<class _Param>
+	inline bool check(const data::Value& value)
+	{
+		if constexpr (is_state<_Param>)
+			return true;
+		else
+			return Argument<std::remove_cvref_t<_Param>>::check(value);
+	}
+
+	template<class _Param>
+	inline decltype(auto) unbox(runtime::RuntimeState& state, const data::Value& value)
+	{
+		if constexpr (is_state<_Param>)
+			return (state);
+		else
+			return Argument<std::remove_cvref_t<_Param>>::get(value);
+	}
+
+	inline const data::Value missing_argument;
+
+
+	template<class _Ty>
+	struct Signature;
+
+	template<class _Ret, class... _Args>
+	struct Signature<_Ret(*)(_Args...)> { using Type = _Ret(_Args...); using Class = void; };
+	template<class _Ret, class... _Args>
+	struct Signature<_Ret(*)(_Args...) noexcept> : Signature<_Ret(*)(_Args...)> {};
+
+	template<class _Class, class _Ret, class... _Args>
+	struct Signature<_Ret(_Class::*)(_Args...)> { using Type = _Ret(_Args...); using Class = _Class; };
+	template<class _Class, class _Ret, class... _Args>
+	struct Signature<_Ret(_Class::*)(_Args...) const> { using Type = _Ret(_Args...); using Class = _Class; };
+	template<class _Class, class _Ret, class... _Args>
+	struct Signature<_Ret(_Class::*)(_Args...) noexcept> { using Type = _Ret(_Args...); using Class = _Class; };
+	template<class _Class, class _Ret, class... _Args>
+	struct Signature<_Ret(_Class::*)(_Args...) const noexcept> { using Type = _Ret(_Args...); using Class = _Class; };
+
+
+	template<class _Ty>
+	struct Binder;
+
+	template<class _Ret, class... _Args>
+	struct Binder<_Ret(_Args...)>
+	{
+		/* A RuntimeState& parameter takes no script argument, it must come first */
+		static constexpr Size skip = (Size(0) + ... + Size(is_state<_Args>));
+		static_assert(skip == 0 || (skip == 1 && leading_state<_Args...>), "runtime::RuntimeState& must be the first native parameter");
+
+		template<class _Callee>
+		static inline bool run(runtime::RuntimeState& state, data::Function& function, const data::Value* args, Size argsCount, data::Value& result, _Callee&& callee)
+		{
+			return run(state, function, args, argsCount, result, callee, std::index_sequence_for<_Args...>());
+		}
+
+	private:
+		template<class _Callee, Size... _Indexes>
+		static inline bool run(runtime::RuntimeState& state, data::Function& function, const data::Value* args, Size argsCount, data::Value& result, _Callee& callee, std::index_sequence<_Indexes...>)
+		{
+			auto arg = [args, argsCount](Size index) -> const data::Value& { return index < argsCount ? args[index] : missing_argument; };
+
+			Size failed = 0;
+			if (!((check<_Args>(arg(_Indexes - skip)) || (failed = _Indexes - skip, false)) && ...))
+				return argument_error(state, function, failed);
+
+			if constexpr (std::is_void_v<_Ret>)
+				callee(unbox<_Args>(state, arg(_Indexes - skip))...);
+			else
+				result = to_value(*function.owner(), callee(unbox<_Args>(state, arg(_Indexes - skip))...));
+
+			if constexpr (skip > 0)
+				return !state.hasError();
+			else
+				return true;
+		}
+	};
+
+
+	template<auto _Function>
+	bool trampoline(runtime::RuntimeState& state, data::Function& function, const data::Value& self, const data::Value* args, Size argsCount, data::Value& result)
+	{
+		using Bound = Signature<decltype(_Function)>;
+		if constexpr (std::is_void_v<typename Bound::Class>)
+		{
+			return Binder<typename Bound::Type>::run(state, function, args, argsCount, result,
+				[](auto&&... params) -> decltype(auto) { return _Function(std::forward<decltype(params)>(params)...); });
+		}
+		else
+		{
+			typename Bound::Class* object = userdata_of<typename Bound::Class>(self);
+			if (!object)
+				return self_error(state, function);
+
+			return Binder<typename Bound::Type>::run(state, function, args, argsCount, result,
+				[object](auto&&... params) -> decltype(auto) { return (object->*_Function)(std::forward<decltype(params)>(params)...); });
+		}
+	}
+
+	template<class _Functor>
+	bool functor_trampoline(runtime::RuntimeState& state, data::Function& function, const data::Value& self, const data::Value* args, Size argsCount, data::Value& result)
+	{
+		const _Functor& functor = *std::launder(reinterpret_cast<const _Functor*>(function.nativeData()));
+		return Binder<typename Signature<decltype(&_Functor::operator())>::Type>::run(state, function, args, argsCount, result, functor);
+	}
+
+
+	template<auto _Function>
+	inline data::Value bind(mem::Heap& heap, const std::string& name = "")
+	{
+		return heap.create_function(&trampoline<_Function>, name);
+	}
+
+	template<class _Functor>
+	inline data::Value bind(mem::Heap& heap, const _Functor& functor, const std::string& name = "")
+	{
+		static_assert(std::is_trivially_copyable_v<_Functor> && sizeof(_Functor) <= data::Function::native_data_size,
+			"a bound functor is stored inline: it must be trivially copyable and fit data::Function::native_data_size");
+		return heap.create_function(&functor_trampoline<_Functor>, name, &functor, sizeof(_Functor));
+	}
+}
@@ -36,16 +36,223 @@ namespace k
 		NEW_ARRAY_C,	//(1): [0] -> [1]
 		NEW_ARRAY_L,	//(0): [1] -> [1]
 
+		ARRAY_REDUCE,	//(1): [1] -> [1]
+		ARRAY_OP,		//(1): [2] -> [1]
+		ARRAY_SLICE,	//(0): [3] -> [1]
+
+		ADD,			//(0): [2] -> [1]
+		SUB,			//(0): [2] -> [1]
+		MUL,			//(0): [2] -> [1]
+		DIV,			//(0): [2] -> [1]
+		MOD,			//(0): [2] -> [1]
+		NEG,			//(0): [1] -> [1]
+
+		EQ,				//(0): [2] -> [1]
+		NE,				//(0): [2] -> [1]
+		LT,				//(0): [2] -> [1]
+		LE,				//(0): [2] -> [1]
+		GT,				//(0): [2] -> [1]
+		GE,				//(0): [2] -> [1]
+
+		/* Quickened forms, written by execute into a Chunk's shadow code only. The verifier rejects them */
+		ADD_II,			//(0): [2] -> [1]
+		SUB_II,			//(0): [2] -> [1]
+		MUL_II,			//(0): [2] -> [1]
+		DIV_II,			//(0): [2] -> [1]
+		MOD_II,			//(0): [2] -> [1]
+		NEG_I,			//(0): [1] -> [1]
+
+		ADD_RR,			//(0): [2] -> [1]
+		SUB_RR,			//(0): [2] -> [1]
+		MUL_RR,			//(0): [2] -> [1]
+		DIV_RR,			//(0): [2] -> [1]
+		MOD_RR,			//(0): [2] -> [1]
+		NEG_R,			//(0): [1] -> [1]
+
+		EQ_II,			//(0): [2] -> [1]
+		NE_II,			//(0): [2] -> [1]
+		LT_II,			//(0): [2] -> [1]
+		LE_II,			//(0): [2] -> [1]
+		GT_II,			//(0): [2] -> [1]
+		GE_II,			//(0): [2] -> [1]
+
+		LT_RR,			//(0): [2] -> [1]
+		LE_RR,			//(0): [2] -> [1]
+		GT_RR,			//(0): [2] -> [1]
+		GE_RR,			//(0): [2] -> [1]
+
 		STORE_S,		//(0): [1] -> [0]
 		STORE_0,		//(0): [1] -> [0]
 		STORE_1,		//(0): [1] -> [0]
 		STORE_2,		//(0): [1] -> [0]
 		STORE_3,		//(0): [1] -> [0]
 		STORE,			//(1): [1] -> [0]
+
+		GET_PROP,		//(4): [1] -> [1]
+		SET_PROP,		//(4): [2] -> [0]
+		GET_METHOD,		//(4): [1] -> [2]
+
+		LOAD_STORE,		//(2): [0] -> [0]
+		LOADC_I_STORE,	//(2): [0] -> [0]
+
+		CALL,			//(1): [n + 2] -> [1]	n = argument count, pops [function, self, args...]
+		TAILCALL,		//(1): [n + 2] -> [0]	as CALL, the callee replaces the current frame
+
+		YIELD,			//(0): [1] -> [1]	suspends the running Fiber, pushes the value it is resumed with
+		RESUME,			//(0): [2] -> [1]	pops [fiber, value], pushes what the fiber yields or returns
+
+		SEND,			//(1): [1] -> [1]	moves var into the channel popped, pushes false if it is full
+		RECEIVE,		//(0): [1] -> [1]	pops a channel, pushes its next message or undefined if it is empty
+
+		RETURN,			//(0): [1] -> [0]
 	};
 }
 
 namespace k::opcode
 {
+	constexpr Size count = static_cast<Size>(Opcode::RETURN) + 1;
+
+	struct Info
+	{
+		const char* name;
+		UInt8 size;		/* Encoded bytes, opcode plus arguments */
+		UInt8 pops;
+		UInt8 pushes;
+	};
+
+	/* One entry per Opcode in enum order, mirrors the comments of the enum */
+	constexpr Info infos[] = {
+		{ "NOP", 1, 0, 0 },
+
+		{ "POP", 1, 1, 0 },
+		{ "POP2", 1, 2, 0 },
+
+		{ "SWAP", 1, 2, 2 },
+
+		{ "DUP", 1, 1, 2 },
+		{ "DUP_X1", 1, 2, 3 },
+		{ "DUP_X2", 1, 3, 4 },
+
+		{ "LOADC_U", 1, 0, 1 },
+		{ "LOADC_B", 2, 0, 1 },
+		{ "LOADC_I", 2, 0, 1 },
+		{ "LOADC_R", 2, 0, 1 },
+		{ "LOADC", 2, 0, 1 },
+		{ "LOADCW", 3, 0, 1 },
+		{ "LOADCL", 5, 0, 1 },
 
+		{ "LOAD_S", 1, 0, 1 },
+		{ "LOAD_0", 1, 0, 1 },
+		{ "LOAD_1", 1, 0, 1 },
+		{ "LOAD_2", 1, 0, 1 },
+		{ "LOAD_3", 1, 0, 1 },
+		{ "LOAD", 2, 0, 1 },
+
+		{ "NEW_ARRAY", 1, 0, 1 },
+		{ "NEW_ARRAY_C", 2, 0, 1 },
+		{ "NEW_ARRAY_L", 1, 1, 1 },
+
+		{ "ARRAY_REDUCE", 2, 1, 1 },
+		{ "ARRAY_OP", 2, 2, 1 },
+		{ "ARRAY_SLICE", 1, 3, 1 },
+
+		{ "ADD", 1, 2, 1 },
+		{ "SUB", 1, 2, 1 },
+		{ "MUL", 1, 2, 1 },
+		{ "DIV", 1, 2, 1 },
+		{ "MOD", 1, 2, 1 },
+		{ "NEG", 1, 1, 1 },
+
+		{ "EQ", 1, 2, 1 },
+		{ "NE", 1, 2, 1 },
+		{ "LT", 1, 2, 1 },
+		{ "LE", 1, 2, 1 },
+		{ "GT", 1, 2, 1 },
+		{ "GE", 1, 2, 1 },
+
+		{ "ADD_II", 1, 2, 1 },
+		{ "SUB_II", 1, 2, 1 },
+		{ "MUL_II", 1, 2, 1 },
+		{ "DIV_II", 1, 2, 1 },
+		{ "MOD_II", 1, 2, 1 },
+		{ "NEG_I", 1, 1, 1 },
+
+		{ "ADD_RR", 1, 2, 1 },
+		{ "SUB_RR", 1, 2, 1 },
+		{ "MUL_RR", 1, 2, 1 },
+		{ "DIV_RR", 1, 2, 1 },
+		{ "MOD_RR", 1, 2, 1 },
+		{ "NEG_R", 1, 1, 1 },
+
+		{ "EQ_II", 1, 2, 1 },
+		{ "NE_II", 1, 2, 1 },
+		{ "LT_II", 1, 2, 1 },
+		{ "LE_II", 1, 2, 1 },
+		{ "GT_II", 1, 2, 1 },
+		{ "GE_II", 1, 2, 1 },
+
+		{ "LT_RR", 1, 2, 1 },
+		{ "LE_RR", 1, 2, 1 },
+		{ "GT_RR", 1, 2, 1 },
+		{ "GE_RR", 1, 2, 1 },
+
+		{ "STORE_S", 1, 1, 0 },
+		{ "STORE_0", 1, 1, 0 },
+		{ "STORE_1", 1, 1, 0 },
+		{ "STORE_2", 1, 1, 0 },
+		{ "STORE_3", 1, 1, 0 },
+		{ "STORE", 2, 1, 0 },
+
+		{ "GET_PROP", 5, 1, 1 },
+		{ "SET_PROP", 5, 2, 0 },
+		{ "GET_METHOD", 5, 1, 2 },
+
+		{ "LOAD_STORE", 3, 0, 0 },
+		{ "LOADC_I_STORE", 3, 0, 0 },
+
+		{ "CALL", 2, 2, 1 },			/* pops are the fixed part, the verifier adds the argument count */
+		{ "TAILCALL", 2, 2, 0 },
+
+		{ "YIELD", 1, 1, 1 },
+		{ "RESUME", 1, 2, 1 },
+		{ "SEND", 2, 1, 1 },
+		{ "RECEIVE", 1, 1, 1 },
+
+		{ "RETURN", 1, 1, 0 },
+	};
+	static_assert(std::size(infos) == count, "opcode::infos must have one entry per Opcode");
+
+	/* Argument of ARRAY_REDUCE: [array] -> [result] */
+	enum class ArrayReduce : UInt8 { Sum, Min, Max };
+	constexpr Size array_reduce_count = static_cast<Size>(ArrayReduce::Max) + 1;
+
+	/* Argument of ARRAY_OP: [array, operand] -> [result]. Add and Mul return a new array, Fill returns the array */
+	enum class ArrayOp : UInt8 { Add, Mul, IndexOf, Equals, Fill };
+	constexpr Size array_op_count = static_cast<Size>(ArrayOp::Fill) + 1;
+
+	constexpr const Info& info(Opcode opcode) { return infos[static_cast<UInt8>(opcode)]; }
+	constexpr Size size(Opcode opcode) { return info(opcode).size; }
+	constexpr const char* name(Opcode opcode) { return info(opcode).name; }
+
+	/* Generic opcode of a quickened form, the opcode itself otherwise */
+	constexpr Opcode generic(Opcode opcode)
+	{
+		switch (opcode)
+		{
+			case Opcode::ADD_II: case Opcode::ADD_RR: return Opcode::ADD;
+			case Opcode::SUB_II: case Opcode::SUB_RR: return Opcode::SUB;
+			case Opcode::MUL_II: case Opcode::MUL_RR: return Opcode::MUL;
+			case Opcode::DIV_II: case Opcode::DIV_RR: return Opcode::DIV;
+			case Opcode::MOD_II: case Opcode::MOD_RR: return Opcode::MOD;
+			case Opcode::NEG_I: case Opcode::NEG_R: return Opcode::NEG;
+			case Opcode::EQ_II: return Opcode::EQ;
+			case Opcode::NE_II: return Opcode::NE;
+			case Opcode::LT_II: case Opcode::LT_RR: return Opcode::LT;
+			case Opcode::LE_II: case Opcode::LE_RR: return Opcode::LE;
+			case Opcode::GT_II: case Opcode::GT_RR: return Opcode::GT;
+			case Opcode::GE_II: case Opcode::GE_RR: return Opcode::GE;
+			default: return opcode;
+		}
+	}
+	constexpr bool isQuickened(Opcode opcode) { return generic(opcode) != opcode; }
 }
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "data.h"
+#include "opcodes.h"
+
+namespace k::runtime
+{
+	class RuntimeState;
+
+	/*
+	 * Generic paths of the arithmetic and comparison opcodes, taken when the inline Integer/Real fast paths of
+	 * execute do not apply. Booleans count as the Integers 0 and 1.
+	 *   Integer op Integer   Integer, or Real when the result overflows
+	 *   mixed numbers        Real
+	 *   ADD with a String    concatenation, the other scalar operand converted to text
+	 * DIV and MOD of Integers truncate toward zero and fail on a zero divisor.
+	 * The failing functions return false after setting the state error.
+	 */
+	bool arithmetic(RuntimeState& state, mem::Heap& heap, Opcode opcode, const data::Value& left, const data::Value& right, data::Value& result);
+	bool negate(RuntimeState& state, mem::Heap& heap, const data::Value& operand, data::Value& result);
+
+	/* Numbers compare by value across Integer and Real, Strings by content and other blocks by identity */
+	bool equals(const data::Value& left, const data::Value& right);
+
+	/* LT/LE/GT/GE of two numbers or two Strings */
+	bool compare(RuntimeState& state, mem::Heap& heap, Opcode opcode, const data::Value& left, const data::Value& right, data::Value& result);
+
+	/* Text of a scalar, as used by String concatenation */
+	data::Value to_string(mem::Heap& heap, const data::Value& value);
+}
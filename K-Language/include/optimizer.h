@@ -0,0 +1,20 @@
+#pragma once
+
+#include "instructions.h"
+
+namespace k::optimizer
+{
+	/*
+	 * Peephole pass run when a Chunk is built: drops no-op sequences (NOP, DUP POP, SWAP SWAP,
+	 * side-effect free loads followed by POP) and fuses LOAD*-STORE* and LOADC_I-STORE* pairs
+	 * into the LOAD_STORE and LOADC_I_STORE superinstructions.
+	 * Bytecode has no branches yet; once it does, sequences must not be folded across a branch target.
+	 */
+	std::vector<instruction::InstructionValue> optimize(const instruction::InstructionValue* code, Size size);
+
+	/*
+	 * Rewrites every constant operand i as indexes[i], re-encoding LOADC/LOADCW/LOADCL with the narrowest form
+	 * that fits. Throws error::BytecodeError if a property name index no longer fits its 16-bit operand.
+	 */
+	std::vector<instruction::InstructionValue> remap_constants(const instruction::InstructionValue* code, Size size, const std::vector<Offset>& indexes);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "data.h"
+
+namespace k::mem
+{
+	/*
+	 * A String/Array/Object graph taken out of its Heap so that another thread can adopt it. Element stores, object
+	 * slots and string buffers are moved, not copied: only the block headers are rebuilt by unpack, in the Heap of
+	 * the receiving thread, and generic stores are walked once to relink their block references.
+	 * Frozen blocks travel as references, Functions and Userdata cannot travel at all.
+	 */
+	class Parcel
+	{
+	private:
+		/* Element of an Array store or slot of an Object referring to another node */
+		struct Link
+		{
+			UInt32 node;
+			UInt32 child;
+			std::ptrdiff_t index;		/* Slot index, or parent_link / class_link for an Object */
+		};
+
+		static constexpr std::ptrdiff_t parent_link = -1;
+		static constexpr std::ptrdiff_t class_link = -2;
+
+		struct Node
+		{
+			data::DataType type;
+
+			/* String: a stolen flat buffer, or the characters of a small or interned one */
+			char* buffer = nullptr;
+			Size size = 0;
+			std::string text;
+
+			/* Array: the store and its holes; Object: the slots in values, the names in slot order, parent and class */
+			data::Array::Storage storage = data::Array::Storage::Generic;
+			bool holey = false;
+			Size holes = 0;
+			std::vector<data::Integer> integers;
+			std::vector<data::Real> reals;
+			std::vector<UInt8> booleans;
+			std::vector<data::Value> values;
+			std::vector<std::pair<std::string, bool>> properties;
+			data::Value parent;
+			data::Value objectClass;
+		};
+
+		std::vector<Node> _nodes;
+		std::vector<Link> _links;
+
+		/* The whole content when the packed value is not a Heap block */
+		data::Value _value;
+
+	public:
+		Parcel() = default;
+		~Parcel();
+
+		Parcel(Parcel&& right) noexcept;
+		Parcel& operator= (Parcel&& right) noexcept;
+
+		Parcel(const Parcel&) = delete;
+		Parcel& operator= (const Parcel&) = delete;
+
+		/*
+		 * Detaches the graph of value from heap and leaves value Undefined. Fails, leaving everything untouched, if
+		 * a block of the graph is a Function or Userdata or is referenced from outside the graph: value must hold
+		 * the only reference to its root, counted (so not a ValueStack slot under K_DEFERRED_RC).
+		 */
+		bool pack(Heap& heap, data::Value& value);
+
+		/* Rebuilds the graph in heap and empties the parcel */
+		data::Value unpack(Heap& heap);
+
+	private:
+		void clear();
+	};
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "runtime.h"
+
+#if K_PROFILER
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace k::runtime
+{
+	/*
+	 * Script profiler of one RuntimeState, and of the Fibers it resumes. execute reports every dispatch to it:
+	 *  - Counting: every executed instruction is counted, by opcode and by Chunk offset.
+	 *  - Sampling: a timer thread raises a flag every interval and the next dispatch takes the sample, the opcode
+	 *    and offset about to run plus the stack of Function names. Natives have no frame: time spent in a native
+	 *    call or in one long instruction is charged to the instruction that follows it.
+	 * Counts are only read once stopped. Chunks are keyed by address, reset before any of them is destroyed.
+	 */
+	class Profiler
+	{
+	public:
+		enum class Mode : UInt8 { Counting, Sampling };
+
+		static constexpr std::chrono::microseconds default_interval{ 1000 };
+
+	private:
+		Mode _mode;
+		std::chrono::microseconds _interval;
+		RuntimeState* _state = nullptr;
+
+		UInt64 _opcodes[opcode::count] = {};
+		std::unordered_map<const Chunk*, std::vector<UInt64>> _chunks;
+		const Chunk* _lastChunk = nullptr;
+		std::vector<UInt64>* _lastCounters = nullptr;
+
+		/* Collapsed stacks, outermost frame first */
+		std::map<std::string, UInt64> _stacks;
+		UInt64 _samples = 0;
+
+		std::atomic<bool> _sampleRequested{ false };
+		std::thread _timer;
+		std::mutex _timerLock;
+		std::condition_variable _timerWake;
+		bool _timerStopping = false;
+
+	public:
+		explicit Profiler(Mode mode, std::chrono::microseconds interval = default_interval);
+		~Profiler();
+
+		Profiler(const Profiler&) = delete;
+		Profiler& operator= (const Profiler&) = delete;
+
+		inline Mode mode() const { return _mode; }
+		inline bool isRunning() const { return _state; }
+
+		/*
+		 * Attaches to state, which must not have another Profiler, and starts the timer when sampling.
+		 * execute picks the Profiler up on entry: start and stop outside of any execute on state.
+		 */
+		void start(RuntimeState& state);
+		void stop();
+
+		void reset();
+
+		inline UInt64 sampleCount() const { return _samples; }
+		inline UInt64 count(Opcode opcode) const { return _opcodes[static_cast<UInt8>(opcode)]; }
+
+		/* Count of each instruction of chunk, indexed by instruction offset, null if it never ran */
+		const std::vector<UInt64>* histogram(const Chunk& chunk) const;
+
+		/* One "outer;inner count" line per sampled stack, the input of flamegraph.pl */
+		void writeCollapsed(std::ostream& out) const;
+
+		void reportOpcodes(std::ostream& out, Size top = 20) const;
+		void reportChunk(std::ostream& out, const Chunk& chunk) const;
+
+	public:
+		inline void dispatch(RuntimeState& state, const Callable* callable, Offset instOffset, Opcode opcode)
+		{
+			if (_mode == Mode::Counting)
+			{
+				++_opcodes[static_cast<UInt8>(opcode)];
+				++counters(callable->chunk())[instOffset];
+			}
+			else if (_sampleRequested.load(std::memory_order_relaxed))
+				sample(state, opcode);
+		}
+
+	private:
+		inline std::vector<UInt64>& counters(const Chunk& chunk)
+		{
+			if (&chunk != _lastChunk)
+			{
+				_lastCounters = &_chunks.try_emplace(&chunk, chunk.instructionsCount()).first->second;
+				_lastChunk = &chunk;
+			}
+			return *_lastCounters;
+		}
+
+		void sample(RuntimeState& state, Opcode opcode);
+		void tick();
+
+		/* Name of the Function in the frame, or the one recorded by its Callable when the frame has none */
+		static std::string_view frameName(data::Value* vars, const Callable& callable);
+	};
+}
+#endif
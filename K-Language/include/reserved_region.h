@@ -0,0 +1,48 @@
+#pragma once
+
+#include "common.h"
+
+namespace k::utils
+{
+	/*
+	 * Address range reserved once and committed on demand, so its contents never move. The page past the
+	 * reservation is never committed and acts as a guard against unchecked overruns.
+	 */
+	class ReservedRegion
+	{
+	public:
+		static constexpr Size commit_granularity = 64 * 1024;
+
+	private:
+		Byte* _base = nullptr;
+		Size _reserved = 0;
+		Size _committed = 0;
+
+	public:
+		ReservedRegion() = default;
+		~ReservedRegion();
+
+		ReservedRegion(const ReservedRegion&) = delete;
+		ReservedRegion& operator= (const ReservedRegion&) = delete;
+
+		ReservedRegion(ReservedRegion&& right) noexcept;
+		ReservedRegion& operator= (ReservedRegion&& right) noexcept;
+
+	public:
+		/* Rounded up to whole pages, throws std::bad_alloc if the address space is not available */
+		void reserve(Size size);
+		void release();
+
+		/* Makes the first size bytes usable, false if they exceed the reservation */
+		inline bool commit(Size size) { return size <= _committed || commit_pages(size); }
+
+		inline Byte* data() const { return _base; }
+		inline Size reserved() const { return _reserved; }
+		inline Size committed() const { return _committed; }
+
+		static Size page_size();
+
+	private:
+		bool commit_pages(Size size);
+	};
+}
@@ -3,9 +3,14 @@
 #include "data.h"
 #include "opcodes.h"
 #include "callable.h"
+#include "reserved_region.h"
 
 namespace k::runtime
 {
+	/*
+	 * Saved caller of a script frame: the offset of its vars in the ValueStack, its Callable and the instruction to
+	 * resume at. A null callable marks the native entry of an execute activation.
+	 */
 	struct CallInfo
 	{
 		std::ptrdiff_t bottom;
@@ -13,61 +18,57 @@ namespace k::runtime
 		std::ptrdiff_t offset;
 	};
 
-	class ValueStack
+	/*
+	 * Values live in one address range reserved up front and committed as the stack grows: frames never move and
+	 * pointers into them stay valid. Running out of the reservation is a stack overflow, reported by push.
+	 */
+	class ValueStack : public mem::RootSet
 	{
 	public:
-		static constexpr Size default_value_count = 8192;
+		static constexpr Size default_value_count = Size(1) << 22;
 		static constexpr Size default_capacity = sizeof(data::Value) * default_value_count;
 
 	private:
+		utils::ReservedRegion _region;
 		data::Value* _bottom;
 		data::Value* _top;
 		data::Value* _current;
-		Size _capacity;
 
 	public:
-		inline ValueStack() :
-			_bottom(utils::malloc<data::Value>(default_capacity)),
-			_top(_bottom + default_value_count),
-			_current(_bottom),
-			_capacity(default_capacity)
-		{}
+		inline explicit ValueStack(Size capacity = default_capacity) :
+			_region()
+		{
+			_region.reserve(capacity);
+			_bottom = _top = _current = reinterpret_cast<data::Value*>(_region.data());
+		}
 
 		inline ~ValueStack()
 		{
+			detach_all();
 			for (data::Value* value = _bottom; value < _current; ++value)
-				value->~Value();
+				destroy_slot(*value);
 
-			utils::free(_bottom);
 			_bottom = _top = _current = nullptr;
 		}
 
 		inline std::ptrdiff_t current_offset() { return _current - _bottom; }
 
-		inline void push(Offset excluded_count, Offset args_count, Size len, data::Value** bottom)
+		inline data::Value* at(std::ptrdiff_t offset) { return _bottom + offset; }
+		inline std::ptrdiff_t offset_of(const data::Value* value) { return value - _bottom; }
+
+		inline bool push(Offset excluded_count, Offset args_count, Size len, data::Value** bottom)
 		{
 			len += 1;
-			if (_current - excluded_count + len > _top)
-			{
-				data::Value* old = _bottom;
-
-				_bottom = utils::malloc<data::Value>(_capacity + default_capacity);
-				std::memcpy(_bottom, old, _capacity);
-
-				_capacity = _capacity + default_capacity;
-				_top = _bottom + _capacity;
-				_current = _bottom + (_current - old);
-
-				utils::free(old);
-			}
-
 			data::Value* base = _current - excluded_count;
-			_current += len;
+			if (!reserve(base + len))
+				return false;
 
-			if(args_count < len)
-				std::memset(base + args_count, 0, sizeof(data::Value) * (len - args_count));
+			_current = base + len;
+			for (data::Value* value = base + args_count; value < _current; ++value)
+				new (value) data::Value();
 
 			*bottom = base;
+			return true;
 		}
 
 		inline void pop(std::uintptr_t bottom)
@@ -78,15 +79,77 @@ namespace k::runtime
 			data::Value* current = _current;
 			Size len = up_current - current;
 			for (Offset i = 0; i < len; ++i)
-				current[i].~Value();
+				destroy_slot(current[i]);
+		}
+
+		/*
+		 * Script frame of len slots starting at base, below the current top: the first argsCount slots are kept
+		 * as the arguments, every other slot from base up is reset. False if the stack would overflow.
+		 */
+		inline bool push_frame(data::Value* base, Size argsCount, Size len)
+		{
+			if (!reserve(base + len))
+				return false;
+
+			for (data::Value* value = base + argsCount; value < _current; ++value)
+				destroy_slot(*value);
+
+			_current = base + len;
+			for (data::Value* value = base + argsCount; value < _current; ++value)
+				new (value) data::Value();
+			return true;
+		}
+
+		/* Drops the script frame starting at base and gives the caller back its slots up to callerEnd */
+		inline void pop_frame(data::Value* base, data::Value* callerEnd)
+		{
+			for (data::Value* value = base; value < _current; ++value)
+				destroy_slot(*value);
+
+			_current = callerEnd;
+			for (data::Value* value = base; value < _current; ++value)
+				new (value) data::Value();
+		}
+
+		void scan_roots(mem::BlockVisitor& visitor) override
+		{
+			for (data::Value* value = _bottom; value < _current; ++value)
+				visitor(*value);
+		}
+
+	private:
+		/* Commits whole granules ahead, the common case is one comparison */
+		inline bool reserve(data::Value* end)
+		{
+			if (end <= _top)
+				return true;
+
+			if (!_region.commit(static_cast<Size>(end - _bottom) * sizeof(data::Value)))
+				return false;
+
+			_top = _bottom + _region.committed() / sizeof(data::Value);
+			return true;
+		}
+
+		static inline void destroy_slot(data::Value& slot)
+		{
+#if K_DEFERRED_RC
+			data::Value::drop_uncounted(slot);
+#else
+			slot.~Value();
+#endif
 		}
 	};
 
+	/*
+	 * CallInfos are only addressed by the interpreter between a push and the next one, so the array starts small
+	 * and doubles on demand up to max_count, the call depth limit.
+	 */
 	class CallStack
 	{
 	public:
-		static constexpr Size info_count = 8192;
-		static constexpr Size capacity = sizeof(CallInfo) * info_count;
+		static constexpr Size default_count = 64;
+		static constexpr Size max_count = 8192;
 
 	private:
 		CallInfo* _bottom;
@@ -94,9 +157,9 @@ namespace k::runtime
 		CallInfo* _current;
 
 	public:
-		inline CallStack() :
-			_bottom(utils::malloc<CallInfo>(capacity)),
-			_top(_bottom + info_count),
+		inline explicit CallStack(Size count = default_count) :
+			_bottom(utils::malloc<CallInfo>(sizeof(CallInfo) * std::min(count, max_count))),
+			_top(_bottom + std::min(count, max_count)),
 			_current(_bottom)
 		{}
 
@@ -106,14 +169,21 @@ namespace k::runtime
 			_bottom = _top = _current = nullptr;
 		}
 
+		CallStack(const CallStack&) = delete;
+		CallStack& operator= (const CallStack&) = delete;
+
+		inline Size depth() const { return static_cast<Size>(_current - _bottom); }
+		inline const CallInfo& at(Size index) const { return _bottom[index]; }
+
 		inline bool push(Callable* callable, std::ptrdiff_t bottom, Size len, std::ptrdiff_t offset)
 		{
-			if (_current >= _top)
+			if (_current >= _top && !grow())
 				return false;
 
 			_current->callable = callable;
 			_current->bottom = bottom;
 			_current->offset = offset;
+			++_current;
 			return true;
 		}
 
@@ -129,10 +199,63 @@ namespace k::runtime
 
 			return --_current;
 		}
+
+	private:
+		inline bool grow()
+		{
+			Size count = static_cast<Size>(_top - _bottom);
+			if (count >= max_count)
+				return false;
+
+			Size newCount = std::min(count * 2, max_count);
+			CallInfo* bottom = utils::malloc<CallInfo>(sizeof(CallInfo) * newCount);
+			std::copy(_bottom, _current, bottom);
+			utils::free(_bottom);
+
+			_current = bottom + count;
+			_bottom = bottom;
+			_top = bottom + newCount;
+			return true;
+		}
 	};
 
+#if K_OPCODE_PAIR_STATS
+	/*
+	 * Dynamic opcode pair counts gathered by execute, the most frequent pairs are superinstruction candidates.
+	 * The counters are process wide and unsynchronized, profile with a single Isolate running.
+	 */
+	void reset_opcode_pairs();
+	void report_opcode_pairs(std::ostream& out, Size top = 20);
+#endif
+
+	class Fiber;
 	class RuntimeState;
-	data::Value execute(RuntimeState& state, Callable& callable, const data::Value* self, const data::Value* args, Size argsCount);
+
+	/* function, when given, is the Function of callable: it names the entry frame in stack traces and profiles */
+	data::Value execute(RuntimeState& state, Callable& callable, const data::Value* self, const data::Value* args, Size argsCount, const data::Value* function = nullptr);
+
+	/* Continues the activation parked in state by YIELD, value becomes the result of the YIELD */
+	data::Value resume(RuntimeState& state, const data::Value& value);
+
+#if K_PROFILER
+	class Profiler;
+
+	/* Registers of a running execute or resume, linked from the innermost one so that a Profiler can walk them */
+	struct Activation
+	{
+		RuntimeState& state;
+		Callable* const& callable;
+		data::Value* const& vars;
+		const Offset& instOffset;
+		Activation* parent;
+
+		Activation(RuntimeState& state, Callable* const& callable, data::Value* const& vars, const Offset& instOffset);
+		~Activation();
+
+		Activation(const Activation&) = delete;
+		Activation& operator= (const Activation&) = delete;
+	};
+#endif
 
 	class RuntimeState
 	{
@@ -145,7 +268,33 @@ namespace k::runtime
 			bool state = false;
 		} _error;
 
+		/* Fiber owning this state, null for a thread root state */
+		Fiber* _fiber = nullptr;
+
+		/* Registers of the activation suspended by YIELD, callable is null when there is none */
+		struct {
+			Callable* callable = nullptr;
+			std::ptrdiff_t vars;
+			std::ptrdiff_t frameBottom;
+			Offset tempsTop;
+			Offset instOffset;
+		} _suspended;
+
+#if K_PROFILER
+		Profiler* _profiler = nullptr;
+		Activation* _activation = nullptr;
+#endif
+
 	public:
+		RuntimeState() = default;
+		inline RuntimeState(Size valueCapacity, Size callCount) :
+			_calls(callCount),
+			_values(valueCapacity)
+		{}
+
+		RuntimeState(const RuntimeState&) = delete;
+		RuntimeState& operator= (const RuntimeState&) = delete;
+
 		inline bool hasError() const { return _error.state; }
 		inline void setError(const data::Value& error)
 		{
@@ -159,7 +308,23 @@ namespace k::runtime
 			_error.state = false;
 		}
 
+		inline Fiber* fiber() const { return _fiber; }
+		inline bool isSuspended() const { return _suspended.callable; }
+
+#if K_PROFILER
+		inline Profiler* profiler() const { return _profiler; }
+#endif
+
+	private:
+		static data::Value run(RuntimeState& state, Callable* callable, const data::Value* function, const data::Value* self, const data::Value* args, Size argsCount, const data::Value* resumed);
+
 	public:
-		friend data::Value execute(RuntimeState& state, Callable& callable, const data::Value* self, const data::Value* args, Size argsCount);
+		friend data::Value execute(RuntimeState& state, Callable& callable, const data::Value* self, const data::Value* args, Size argsCount, const data::Value* function);
+		friend data::Value resume(RuntimeState& state, const data::Value& value);
+		friend class Fiber;
+#if K_PROFILER
+		friend struct Activation;
+		friend class Profiler;
+#endif
 	};
 }
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "isolate.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace k::runtime
+{
+	/*
+	 * Pool of worker threads, each owning one Isolate. Every worker has its own task deque: it runs its newest task
+	 * first and, once empty, steals the oldest task of another worker. Tasks submitted from a worker go to its own
+	 * deque, others are dealt round robin. Workers with nothing to run or steal sleep until a task is pushed.
+	 * A task waiting on the future of another task must go through wait, which runs queued tasks meanwhile.
+	 */
+	class Scheduler
+	{
+	public:
+		typedef std::function<void(Isolate&)> Task;
+
+		/* Longest pause of a worker that sees pending tasks it cannot reach yet, and of wait between retries */
+		static constexpr std::chrono::microseconds max_backoff{ 1000 };
+
+	private:
+		struct Worker
+		{
+			std::mutex lock;
+			std::deque<Task> tasks;
+			std::thread thread;
+		};
+
+		std::vector<std::unique_ptr<Worker>> _workers;
+		std::atomic<Size> _next{ 0 };
+
+		std::atomic<Size> _pending{ 0 };
+		std::atomic<Size> _sleeping{ 0 };
+		std::mutex _sleepLock;
+		std::condition_variable _wake;
+		bool _stopping = false;
+
+	public:
+		explicit Scheduler(Size threads = std::max<Size>(1, std::thread::hardware_concurrency()));
+
+		/* Runs every task already submitted, then joins the workers */
+		~Scheduler();
+
+		Scheduler(const Scheduler&) = delete;
+		Scheduler& operator= (const Scheduler&) = delete;
+
+		inline Size size() const { return _workers.size(); }
+
+		/* function(Isolate&) runs on some worker, its result or exception reaches the future */
+		template<class _Fn>
+		auto submit(_Fn&& function) -> std::future<std::invoke_result_t<std::decay_t<_Fn>&, Isolate&>>
+		{
+			using Result = std::invoke_result_t<std::decay_t<_Fn>&, Isolate&>;
+
+			auto task = std::make_shared<std::packaged_task<Result(Isolate&)>>(std::forward<_Fn>(function));
+			std::future<Result> future = task->get_future();
+			push([task](Isolate& isolate) { (*task)(isolate); });
+			return future;
+		}
+
+		/* Isolate::invoke on some worker, args are copied into the task */
+		template<class _Ret, class... _Args>
+		std::future<_Ret> invoke(std::shared_ptr<const Program> program, _Args&&... args)
+		{
+			return submit([program = std::move(program), ...args = std::forward<_Args>(args)](Isolate& isolate) -> _Ret {
+				return isolate.invoke<_Ret>(*program, args...);
+			});
+		}
+
+		/*
+		 * future.get(), except on a worker of this Scheduler where the queued tasks are run until future is ready:
+		 * a task blocked on a task still queued behind it would otherwise hold its worker, or the whole pool.
+		 */
+		template<class _Ty>
+		_Ty wait(std::future<_Ty> future)
+		{
+			std::chrono::microseconds backoff{ 1 };
+			while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				if (!run_one())
+				{
+					if (!isWorker())
+						break;
+					future.wait_for(backoff);
+					backoff = std::min(backoff * 2, max_backoff);
+				}
+				else
+					backoff = std::chrono::microseconds(1);
+			}
+			return future.get();
+		}
+
+	private:
+		void push(Task&& task);
+		void work(Size index);
+
+		bool isWorker() const;
+
+		/* Runs one queued task on the calling worker, false off a worker or with nothing to run */
+		bool run_one();
+
+		/* Blocks until a task is available, false once stopping with nothing left to run */
+		bool take(Size index, Task& task);
+		bool pop(Size index, Task& task);
+		bool steal(Size index, Task& task);
+	};
+}
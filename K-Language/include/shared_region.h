@@ -0,0 +1,74 @@
+#pragma once
+
+#include "data.h"
+
+#include <mutex>
+
+namespace k::mem
+{
+	/*
+	 * Immutable blocks readable by every Isolate at once. freeze deep copies a String/Array/Object graph into the
+	 * region, where blocks are immortal: never counted, never collected, and released with the region, which must
+	 * outlive every Value referring to them. Scripts cannot assign to a frozen Object nor fill a frozen Array, and
+	 * host code must not mutate them either.
+	 */
+	class SharedRegion
+	{
+	private:
+		std::mutex _lock;
+		std::vector<MemoryBlock*> _blocks;
+
+		/* Frozen Objects transition from this shape, never from the shapes of a Heap */
+		data::Shape _rootShape{ true };
+
+#if K_NAN_BOXING
+		std::vector<data::Value::IntegerBox*> _boxes;
+#endif
+
+	public:
+		SharedRegion() = default;
+		~SharedRegion();
+
+		SharedRegion(const SharedRegion&) = delete;
+		SharedRegion& operator= (const SharedRegion&) = delete;
+
+		/*
+		 * Frozen copy of value. Scalars are returned as they are and frozen blocks are reused, the sharing and
+		 * cycles of the copied graph are preserved. Throws error::RuntimeError on a Function or Userdata.
+		 * Must run on the thread owning the Heap of value, other threads may freeze into the region meanwhile.
+		 */
+		data::Value freeze(const data::Value& value);
+
+		Size blockCount();
+
+	private:
+		typedef std::unordered_map<const MemoryBlock*, data::Value> Copies;
+
+		/* An Array or Object copy whose elements are still to be copied */
+		struct Pending
+		{
+			data::DataType type;
+			const MemoryBlock* source;
+			MemoryBlock* copy;
+		};
+
+		/*
+		 * Sealed frozen counterpart of value. Strings are copied at once, Arrays and Objects are allocated empty and
+		 * pushed on pending: freeze copies their elements from an explicit stack, however deep the graph is.
+		 */
+		data::Value copy(const data::Value& value, Copies& copies, std::vector<Pending>& pending);
+		void copy_elements(const Pending& next, Copies& copies, std::vector<Pending>& pending);
+
+		/* Gives a boxed Integer slot a box of its own that is never counted */
+		void seal(data::Value& slot);
+
+		template<std::derived_from<MemoryBlock> _Ty, typename... _Args>
+		_Ty* allocate(_Args&&... args)
+		{
+			_Ty* block = new _Ty(std::forward<_Args>(args)...);
+			block->_flags |= MemoryBlock::flag_frozen;
+			_blocks.push_back(block);
+			return block;
+		}
+	};
+}
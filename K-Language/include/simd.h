@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.h"
+
+namespace k::simd
+{
+	enum class Level : UInt8 { Scalar, SSE2, AVX2 };
+
+	/*
+	 * Bulk kernels over packed Array stores. Every level returns bit-identical results: real sums and min/max
+	 * reduce 4 interleaved lanes combined as (l0 op l2) op (l1 op l3), then fold the tail in order.
+	 * Integer arithmetic wraps and returns true if anything overflowed, the caller then promotes to Real.
+	 * Min/max of reals return NaN if any element is NaN.
+	 */
+	struct Kernels
+	{
+		void (*fill_integer)(Int64* dst, Size count, Int64 value);
+		void (*fill_real)(double* dst, Size count, double value);
+
+		/* True if a partial sum overflowed, *sum is the wrapped total either way */
+		bool (*sum_integer)(const Int64* src, Size count, Int64* sum);
+		double (*sum_real)(const double* src, Size count);
+		Size (*count_true)(const UInt8* src, Size count);
+
+		/* count must be greater than 0 */
+		Int64 (*min_integer)(const Int64* src, Size count);
+		Int64 (*max_integer)(const Int64* src, Size count);
+		double (*min_real)(const double* src, Size count);
+		double (*max_real)(const double* src, Size count);
+
+		/* True if an element overflowed */
+		bool (*add_integer)(Int64* dst, const Int64* left, const Int64* right, Size count);
+		bool (*mul_integer)(Int64* dst, const Int64* left, const Int64* right, Size count);
+		void (*add_real)(double* dst, const double* left, const double* right, Size count);
+		void (*mul_real)(double* dst, const double* left, const double* right, Size count);
+
+		/* count if not found */
+		Offset (*index_of_integer)(const Int64* src, Size count, Int64 value);
+		Offset (*index_of_real)(const double* src, Size count, double value);
+
+		/* Real equality is IEEE: NaN differs from everything, -0 equals +0 */
+		bool (*equal_real)(const double* left, const double* right, Size count);
+	};
+
+	/* Best level supported by the CPU and the OS */
+	Level detected();
+
+	/* Level in use, detected() unless lowered with select */
+	Level level();
+
+	/* Switches to a lower level, for benchmarks and tests. Levels above detected() are clamped */
+	void select(Level level);
+
+	const char* name(Level level);
+
+	const Kernels& kernels();
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "common.h"
+
+namespace k::mem
+{
+	class SlabAllocator
+	{
+	public:
+		static constexpr Size page_size = 64 * 1024;
+		static constexpr Size granularity = 16;
+		static constexpr Size max_block_size = 512;
+		static constexpr Size class_count = max_block_size / granularity;
+
+		static constexpr UInt8 large_class = 0xFF;
+
+		static constexpr UInt8 size_class(Size size)
+		{
+			return size > max_block_size ? large_class : static_cast<UInt8>((size + granularity - 1) / granularity - 1);
+		}
+
+		static constexpr Size class_size(UInt8 sizeClass) { return (static_cast<Size>(sizeClass) + 1) * granularity; }
+
+	private:
+		struct FreeSlot
+		{
+			FreeSlot* next;
+		};
+
+		struct Page
+		{
+			SlabAllocator* owner;
+			Page* next;
+			Page* prev;
+			FreeSlot* free;
+			Byte* bump;
+			Byte* end;
+			UInt32 live;
+			UInt8 sizeClass;
+			bool available;
+		};
+
+		static constexpr Size page_header_size = (sizeof(Page) + granularity - 1) / granularity * granularity;
+
+		struct Pool
+		{
+			Page* available = nullptr;
+			Page* full = nullptr;
+		};
+
+	private:
+		Pool _pools[class_count] = {};
+		Size _pageCount = 0;
+
+	public:
+		SlabAllocator() = default;
+		~SlabAllocator();
+
+		SlabAllocator(const SlabAllocator&) = delete;
+		SlabAllocator& operator= (const SlabAllocator&) = delete;
+
+	public:
+		inline void* allocate(UInt8 sizeClass)
+		{
+			Page* page = _pools[sizeClass].available;
+			if (!page)
+				page = new_page(sizeClass);
+
+			void* slot;
+			if (page->free)
+			{
+				slot = page->free;
+				page->free = page->free->next;
+			}
+			else
+			{
+				slot = page->bump;
+				page->bump += class_size(sizeClass);
+			}
+
+			++page->live;
+			if (!page->free && page->bump + class_size(sizeClass) > page->end)
+				retire_page(page);
+
+			return slot;
+		}
+
+		inline void deallocate(void* ptr)
+		{
+			Page* page = page_of(ptr);
+			FreeSlot* slot = reinterpret_cast<FreeSlot*>(ptr);
+
+			slot->next = page->free;
+			page->free = slot;
+			--page->live;
+
+			if (!page->available)
+				restore_page(page);
+			else if (page->live == 0)
+				reclaim_page(page);
+		}
+
+		inline Size pageCount() const { return _pageCount; }
+
+	private:
+		static inline Page* page_of(void* ptr)
+		{
+			return reinterpret_cast<Page*>(reinterpret_cast<std::uintptr_t>(ptr) & ~(static_cast<std::uintptr_t>(page_size) - 1));
+		}
+
+		Page* new_page(UInt8 sizeClass);
+		void retire_page(Page* page);
+		void restore_page(Page* page);
+		void reclaim_page(Page* page);
+
+		static void unlink(Page*& list, Page* page);
+		static void link(Page*& list, Page* page);
+	};
+}
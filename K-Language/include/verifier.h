@@ -0,0 +1,21 @@
+#pragma once
+
+#include "chunk.h"
+
+namespace k::verifier
+{
+	/*
+	 * Abstract interpretation of the stack depth over every path of a chunk's code.
+	 * Rejects, with error::BytecodeError, undecodable instructions, stack underflows,
+	 * out of range variable or constant operands, non-String property names and
+	 * paths that run past the end without a RETURN. execute relies on it and performs no such checks.
+	 * Returns the exact maximum number of temps the code uses.
+	 */
+	Size verify(
+		const instruction::InstructionValue* code,
+		Size size,
+		Size varsCount,
+		const Chunk::Constant::Type* constantTypes,
+		Size constantsCount
+	);
+}
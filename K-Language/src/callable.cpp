@@ -2,15 +2,19 @@
 
 namespace k
 {
-	Callable::Callable(const Chunk& chunk, Size upsCount) :
+	Callable::Callable(const Chunk& chunk, Size upsCount, const std::string* name) :
 		_chunk(&chunk),
+		_name(name),
 		_ups(upsCount == 0 ? nullptr : new data::Value[upsCount]),
 		_upsCount(upsCount),
 		_locals()
-	{}
+	{
+		chunk.materialize_constants();
+	}
 
 	Callable::Callable(Callable&& right) noexcept :
 		_chunk(right._chunk),
+		_name(right._name),
 		_ups(right._ups),
 		_upsCount(right._upsCount),
 		_locals(std::move(right._locals))
@@ -51,4 +55,13 @@ namespace k
 		for (Offset i = 0; i < len; ++i)
 			dst[i] = ups[i];
 	}
+
+	void Callable::traverse(mem::BlockVisitor& visitor)
+	{
+		for (Offset i = 0; i < _upsCount; ++i)
+			visitor(_ups[i]);
+
+		for (const auto& local : _locals)
+			visitor(local.second);
+	}
 }
@@ -0,0 +1,42 @@
+#include "channel.h"
+
+namespace k::runtime
+{
+	Channel::Channel(Size capacity) :
+		_queue(capacity)
+	{}
+
+	Channel::Status Channel::send(mem::Heap& heap, data::Value& value)
+	{
+		/* Packing is not free, skip it when the push would surely fail */
+		if (_queue.size() >= _queue.capacity())
+			return Status::Full;
+
+		mem::Parcel parcel;
+		if (!parcel.pack(heap, value))
+			return Status::Rejected;
+
+		/* Lost the last slot to another sender: the graph is already taken apart, hand back a rebuilt one */
+		if (!_queue.try_push(std::move(parcel)))
+		{
+			value = parcel.unpack(heap);
+			return Status::Full;
+		}
+		return Status::Sent;
+	}
+
+	bool Channel::receive(mem::Heap& heap, data::Value& value)
+	{
+		mem::Parcel parcel;
+		if (!_queue.try_pop(parcel))
+			return false;
+
+		value = parcel.unpack(heap);
+		return true;
+	}
+
+	data::Value Channel::endpoint(mem::Heap& heap, const std::shared_ptr<Channel>& channel)
+	{
+		return heap.create_userdata<std::shared_ptr<Channel>>(channel);
+	}
+}
@@ -1,4 +1,7 @@
 #include "chunk.h"
+#include "optimizer.h"
+#include "verifier.h"
+#include "image.h"
 
 namespace k
 {
@@ -168,7 +171,7 @@ namespace k
 				return _boolean;
 
 			case Type::String:
-				return heap.create_string(*_string);
+				return heap.intern(*_string);
 		}
 	}
 
@@ -230,6 +233,61 @@ namespace k
 
 namespace k
 {
+	namespace
+	{
+		/* Deduplicates constant Values by type and bits, strings are interned so their identity is their pointer */
+		class ConstantPool
+		{
+		private:
+			struct Key
+			{
+				data::DataType type;
+				UInt64 bits;
+
+				bool operator== (const Key&) const = default;
+			};
+
+			struct KeyHash
+			{
+				Size operator() (const Key& key) const
+				{
+					return std::hash<UInt64>{}(key.bits) ^ (static_cast<Size>(key.type) * 0x9e3779b97f4a7c15ULL);
+				}
+			};
+
+			std::vector<data::Value> _values;
+			std::unordered_map<Key, Offset, KeyHash> _indexes;
+
+		public:
+			Offset add(const data::Value& value)
+			{
+				Key key = { value.type(), 0 };
+				switch (value.type())
+				{
+					case data::DataType::Integer: key.bits = static_cast<UInt64>(value.integer()); break;
+					case data::DataType::Real: key.bits = std::bit_cast<UInt64>(value.real()); break;
+					case data::DataType::Boolean: key.bits = value.boolean() ? 1 : 0; break;
+					case data::DataType::String: key.bits = reinterpret_cast<std::uintptr_t>(&value.string()); break;
+					default: break;
+				}
+
+				auto [it, inserted] = _indexes.try_emplace(key, _values.size());
+				if (inserted)
+					_values.push_back(value);
+				return it->second;
+			}
+
+			inline Size size() const { return _values.size(); }
+			inline data::Value& operator[] (Offset index) { return _values[index]; }
+		};
+
+		struct Rewrite
+		{
+			Chunk* chunk;
+			std::vector<instruction::InstructionValue> code;
+		};
+	}
+
 	Chunk::Chunk(
 		mem::Heap& heap,
 		Chunk* chunks,
@@ -242,33 +300,97 @@ namespace k
 		Size tempsCount
 	) :
 		_heap(&heap),
-		_chunkCount(chunksCount),
-		_chunks(chunksCount == 0 ? nullptr : new Chunk[chunksCount]),
-		_constantsCount(constantsCount),
-		_constants(constantsCount == 0 ? nullptr : new data::Value[constantsCount]),
-		_instructionsCount(instructionsCount),
-		_instructions(instructionsCount == 0 ? nullptr : new instruction::InstructionValue[instructionsCount]),
+		_chunkCount(0),
+		_chunks(nullptr),
+		_constantsCount(0),
+		_constants(nullptr),
+		_instructionsCount(0),
+		_instructions(nullptr),
 		_varsCount(varsCount),
 		_tempsCount(tempsCount)
 	{
-		for (Offset i = 0; i < chunksCount; ++i)
-			utils::move(_chunks[i], std::move(*chunks));
+		/* Verify before taking anything, a rejected chunk leaves the children untouched */
+		std::vector<Constant::Type> constantTypes(constantsCount);
+		for (Offset i = 0; i < constantsCount; ++i)
+			constantTypes[i] = constants[i].type();
+
+		std::vector<instruction::InstructionValue> code = optimizer::optimize(instructions, instructionsCount);
+		_tempsCount = verifier::verify(code.data(), code.size(), varsCount, constantTypes.data(), constantsCount);
 
+		/* Merge every constant of the tree into one pool. Nothing is modified until all the code has been renumbered */
+		ConstantPool pool;
+		std::vector<Offset> indexes(constantsCount);
 		for (Offset i = 0; i < constantsCount; ++i)
-			_constants[i] = constants[i].make_value(heap);
+			indexes[i] = pool.add(constants[i].make_value(heap));
+		if (pool.size() < constantsCount)
+			code = optimizer::remap_constants(code.data(), code.size(), indexes);
+
+		std::vector<Rewrite> rewrites;
+		auto renumber = [&pool, &rewrites](auto& self, Chunk& chunk, const data::Value* parentConstants, const std::vector<Offset>& parentIndexes) -> void {
+			std::vector<Offset> ownIndexes;
+			if (!chunk._sharedConstants || chunk._constants != parentConstants)
+			{
+				chunk.materialize_constants();
+				ownIndexes.resize(chunk._constantsCount);
+				for (Offset i = 0; i < chunk._constantsCount; ++i)
+					ownIndexes[i] = pool.add(chunk._constants[i]);
+			}
+			const std::vector<Offset>& chunkIndexes = ownIndexes.empty() ? parentIndexes : ownIndexes;
+
+			rewrites.push_back({ &chunk, optimizer::remap_constants(chunk._instructions, chunk._instructionsCount, chunkIndexes) });
+			for (Offset i = 0; i < chunk._chunkCount; ++i)
+				self(self, chunk._chunks[i], chunk._constants, chunkIndexes);
+		};
+		for (Offset i = 0; i < chunksCount; ++i)
+			renumber(renumber, chunks[i], nullptr, {});
+
+		_constantsCount = pool.size();
+		_constants = _constantsCount == 0 ? nullptr : new data::Value[_constantsCount];
+		for (Offset i = 0; i < _constantsCount; ++i)
+			_constants[i] = std::move(pool[i]);
 
-		if (instructionsCount > 0)
-			std::memcpy(_instructions, instructions, instructionsCount * sizeof(instruction::InstructionValue));
+		for (Rewrite& rewrite : rewrites)
+		{
+			Chunk& chunk = *rewrite.chunk;
+			if (chunk._instructions && !chunk._mappedCode)
+				delete[] chunk._instructions;
+			if (chunk._quickened)
+			{
+				delete[] chunk._quickened;
+				chunk._quickened = nullptr;
+			}
+			chunk._instructionsCount = rewrite.code.size();
+			chunk._instructions = new instruction::InstructionValue[chunk._instructionsCount];
+			std::memcpy(chunk._instructions, rewrite.code.data(), chunk._instructionsCount * sizeof(instruction::InstructionValue));
+			chunk._mappedCode = false;
+		}
+		for (Rewrite& rewrite : rewrites)
+			rewrite.chunk->adopt_constants(_constants, _constantsCount);
+
+		_chunkCount = chunksCount;
+		_chunks = chunksCount == 0 ? nullptr : new Chunk[chunksCount];
+		for (Offset i = 0; i < chunksCount; ++i)
+			utils::move(_chunks[i], std::move(chunks[i]));
+
+		_instructionsCount = code.size();
+		_instructions = new instruction::InstructionValue[_instructionsCount];
+		std::memcpy(_instructions, code.data(), _instructionsCount * sizeof(instruction::InstructionValue));
+
+		link_property_caches();
 	}
 
 	Chunk::~Chunk()
 	{
 		if (_chunks)
 			delete[] _chunks;
-		if (_constants)
+		if (_constants && !_sharedConstants)
 			delete[] _constants;
-		if (_instructions)
+		if (_instructions && !_mappedCode)
 			delete[] _instructions;
+		if (_quickened)
+			delete[] _quickened;
+		if (_propertyCaches)
+			delete[] _propertyCaches;
 	}
 
 	Chunk::Chunk(Chunk&& right) noexcept :
@@ -277,10 +399,17 @@ namespace k
 		_chunkCount(right._chunkCount),
 		_constants(right._constants),
 		_constantsCount(right._constantsCount),
+		_sharedConstants(right._sharedConstants),
 		_instructions(right._instructions),
 		_instructionsCount(right._instructionsCount),
 		_varsCount(right._varsCount),
-		_tempsCount(right._tempsCount)
+		_tempsCount(right._tempsCount),
+		_propertyCaches(right._propertyCaches),
+		_propertyCachesCount(right._propertyCachesCount),
+		_mappedCode(right._mappedCode),
+		_pendingConstants(right._pendingConstants),
+		_strings(right._strings),
+		_quickened(right._quickened)
 	{
 		utils::construct(right);
 	}
@@ -290,4 +419,99 @@ namespace k
 		this->~Chunk();
 		return utils::move(*this, std::move(right));
 	}
+
+	void Chunk::materialize_constants() const
+	{
+		if (!_pendingConstants)
+			return;
+
+		for (Offset i = 0; i < _constantsCount; ++i)
+		{
+			const image::ConstantRecord& record = _pendingConstants[i];
+			switch (static_cast<Constant::Type>(record.type))
+			{
+				default:
+				case Constant::Type::Undefined:
+					_constants[i] = nullptr;
+					break;
+
+				case Constant::Type::Integer:
+					_constants[i] = record.integer;
+					break;
+
+				case Constant::Type::Real:
+					_constants[i] = record.real;
+					break;
+
+				case Constant::Type::Boolean:
+					_constants[i] = record.boolean != 0;
+					break;
+
+				case Constant::Type::String:
+					_constants[i] = _heap->intern(std::string_view(_strings + record.stringOffset, record.stringSize));
+					break;
+			}
+		}
+
+		_pendingConstants = nullptr;
+	}
+
+	void Chunk::materialize_code() const
+	{
+		if (_quickened)
+			return;
+
+		Size bitmapSize = (_instructionsCount + 7) / 8;
+		_quickened = new instruction::InstructionValue[_instructionsCount + bitmapSize];
+		std::memcpy(_quickened, _instructions, _instructionsCount * sizeof(instruction::InstructionValue));
+		std::memset(_quickened + _instructionsCount, 0, bitmapSize * sizeof(instruction::InstructionValue));
+	}
+
+	void Chunk::adopt_constants(data::Value* pool, Size count)
+	{
+		if (_constants && !_sharedConstants)
+			delete[] _constants;
+
+		_constants = pool;
+		_constantsCount = count;
+		_sharedConstants = true;
+		_pendingConstants = nullptr;
+	}
+
+	void Chunk::link_property_caches(bool assign)
+	{
+		Size count = 0;
+		for (Offset offset = 0; offset < _instructionsCount;)
+		{
+			Opcode opcode = static_cast<Opcode>(_instructions[offset]);
+			if (static_cast<Size>(opcode) >= opcode::count)
+				break;
+
+			switch (opcode)
+			{
+				case Opcode::GET_PROP:
+				case Opcode::SET_PROP:
+				case Opcode::GET_METHOD:
+					if (assign)
+						instruction::arg::set<instruction::arg::uword>(_instructions + offset + 3, static_cast<instruction::arg::uword>(count));
+					else if (instruction::arg::get<instruction::arg::uword>(_instructions + offset + 3) != count)
+						throw error::BytecodeError("property cache operand out of sequence at offset " + std::to_string(offset));
+					++count;
+					break;
+
+				default:
+					break;
+			}
+
+			offset += opcode::size(opcode);
+		}
+
+		allocate_property_caches(count);
+	}
+
+	void Chunk::allocate_property_caches(Size count)
+	{
+		_propertyCachesCount = count;
+		_propertyCaches = count == 0 ? nullptr : new runtime::PropertyCache[count];
+	}
 }
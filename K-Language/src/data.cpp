@@ -1,4 +1,5 @@
 #include "data.h"
+#include "simd.h"
 #include "callable.h"
 #include "runtime.h"
 
@@ -7,84 +8,848 @@ namespace k::data
 	using mem::MemoryBlock;
 
 
-	Array::Array(Value* array, Size len) :
+	String::String(std::string_view str) :
 		MemoryBlock(),
-		_array(len)
+		_form(str.size() <= small_capacity ? Form::Small : Form::Flat),
+		_size(str.size())
 	{
-		for (Value* ptr = _array.data(); len > 0; --len, ++ptr, ++array)
-			*ptr = *array;
+		char* buffer = _form == Form::Small ? _storage.small : (_storage.flat = new char[_size + 1]);
+		std::memcpy(buffer, str.data(), _size);
+		buffer[_size] = 0;
 	}
 
-	Array::Array(const std::vector<Value>& vector) :
+	String::String(const Value& left, const Value& right) :
 		MemoryBlock(),
-		_array(vector)
+		_form(Form::Rope),
+		_size(left.string().size() + right.string().size())
+	{
+		std::construct_at(&_storage.rope, Rope{ left, right });
+	}
+
+	String::~String()
+	{
+		switch (_form)
+		{
+			case Form::Flat:
+				delete[] _storage.flat;
+				break;
+
+			case Form::Rope: {
+				/*
+				 * Releasing a child may destroy it and, through its own children, recurse once per level of a
+				 * long left-deep rope. The outermost rope destructor drains the children of the nested ones instead.
+				 */
+				static thread_local std::vector<Value>* pending = nullptr;
+				if (pending)
+				{
+					pending->push_back(std::move(_storage.rope.left));
+					pending->push_back(std::move(_storage.rope.right));
+					std::destroy_at(&_storage.rope);
+					break;
+				}
+
+				std::vector<Value> children;
+				children.push_back(std::move(_storage.rope.left));
+				children.push_back(std::move(_storage.rope.right));
+				std::destroy_at(&_storage.rope);
+
+				pending = &children;
+				while (!children.empty())
+				{
+					Value child = std::move(children.back());
+					children.pop_back();
+				}
+				pending = nullptr;
+			} break;
+
+			default:
+				break;
+		}
+	}
+
+	void String::flatten() const
+	{
+		char* buffer = new char[_size + 1];
+		char* cursor = buffer;
+
+		/* Iterative in-order walk, ropes built by repeated appends are as deep as they are long */
+		std::vector<const String*> stack = { &_storage.rope.right.string(), &_storage.rope.left.string() };
+		while (!stack.empty())
+		{
+			const String* node = stack.back();
+			stack.pop_back();
+
+			if (node->_form == Form::Rope)
+			{
+				stack.push_back(&node->_storage.rope.right.string());
+				stack.push_back(&node->_storage.rope.left.string());
+			}
+			else
+			{
+				std::memcpy(cursor, node->_form == Form::Small ? node->_storage.small : node->_storage.flat, node->_size);
+				cursor += node->_size;
+			}
+		}
+		buffer[_size] = 0;
+
+		std::destroy_at(&_storage.rope);
+		_storage.flat = buffer;
+		_form = Form::Flat;
+	}
+
+
+
+	Array::Array() :
+		MemoryBlock(),
+		_storage(Storage::Integer),
+		_integers()
+	{}
+
+	Array::~Array()
+	{
+		reset(Storage::Integer);
+		std::destroy_at(&_integers);
+	}
+
+	Array::Array(const Value* array, Size len) :
+		Array()
+	{
+		for (Offset i = 0; i < len; ++i)
+			push_back(array[i]);
+	}
+
+	Array::Array(const std::vector<Value>& vector) :
+		Array(vector.data(), vector.size())
 	{}
 
 	Array::Array(std::vector<Value>&& vector) noexcept :
 		MemoryBlock(),
-		_array(std::move(vector))
+		_storage(Storage::Generic),
+		_values(std::move(vector))
 	{}
 
 	Array::Array(std::initializer_list<Value> args) :
-		MemoryBlock(),
-		_array(args)
+		Array(args.begin(), args.size())
 	{}
 
 	Array::Array(Size length, const Value& default_value) :
-		MemoryBlock(),
-		_array(length, default_value)
-	{}
+		Array()
+	{
+		resize(length, default_value);
+	}
 
 	Array::Array(Size length) :
-		MemoryBlock(),
-		_array(length)
+		Array(length, Value())
 	{}
 
+	DataType Array::typeOf(Offset index) const
+	{
+		switch (_storage)
+		{
+			case Storage::Integer: return DataType::Integer;
+			case Storage::Real: return DataType::Real;
+			case Storage::Boolean: return DataType::Boolean;
+			default: return _values[index].type();
+		}
+	}
+
+	void Array::resize(Size new_len)
+	{
+		resize(new_len, Value());
+	}
+
+	void Array::resize(Size new_len, const Value& fill)
+	{
+		if (new_len > size())
+			prepare(fill);
+
+		switch (_storage)
+		{
+			case Storage::Integer: _integers.resize(new_len, _storage == storage_of(fill) ? fill.integer() : 0); break;
+			case Storage::Real: _reals.resize(new_len, _storage == storage_of(fill) ? fill.real() : 0); break;
+			case Storage::Boolean: _booleans.resize(new_len, _storage == storage_of(fill) && fill.boolean()); break;
+			default:
+				if (_holey)
+				{
+					for (Offset i = new_len; i < _values.size(); ++i)
+						forget_hole(_values[i]);
+					if (new_len > _values.size())
+					{
+						record_hole(fill);
+						if (fill.type() == DataType::Undefined)
+							_holes += new_len - _values.size() - 1;
+					}
+				}
+				_values.resize(new_len, fill);
+				pack_filled();
+				break;
+		}
+	}
+
+	void Array::push_back(const Value& value)
+	{
+		prepare(value);
+		switch (_storage)
+		{
+			case Storage::Integer: _integers.push_back(value.integer()); break;
+			case Storage::Real: _reals.push_back(value.real()); break;
+			case Storage::Boolean: _booleans.push_back(value.boolean()); break;
+			default:
+				if (_holey)
+					record_hole(value);
+				_values.push_back(value);
+				pack_filled();
+				break;
+		}
+	}
+
+	void Array::insert(Offset where, const Value& value)
+	{
+		prepare(value);
+		switch (_storage)
+		{
+			case Storage::Integer: _integers.insert(_integers.begin() + where, value.integer()); break;
+			case Storage::Real: _reals.insert(_reals.begin() + where, value.real()); break;
+			case Storage::Boolean: _booleans.insert(_booleans.begin() + where, value.boolean()); break;
+			default:
+				if (_holey)
+					record_hole(value);
+				_values.insert(_values.begin() + where, value);
+				pack_filled();
+				break;
+		}
+	}
+
+	void Array::pop_back()
+	{
+		switch (_storage)
+		{
+			case Storage::Integer: _integers.pop_back(); break;
+			case Storage::Real: _reals.pop_back(); break;
+			case Storage::Boolean: _booleans.pop_back(); break;
+			default:
+				if (_holey)
+					forget_hole(_values.back());
+				_values.pop_back();
+				pack_filled();
+				break;
+		}
+	}
+
+	void Array::erase(Offset where)
+	{
+		erase(where, where + 1);
+	}
+
+	void Array::erase(Offset first, Offset last)
+	{
+		switch (_storage)
+		{
+			case Storage::Integer: _integers.erase(_integers.begin() + first, _integers.begin() + last); break;
+			case Storage::Real: _reals.erase(_reals.begin() + first, _reals.begin() + last); break;
+			case Storage::Boolean: _booleans.erase(_booleans.begin() + first, _booleans.begin() + last); break;
+			default:
+				if (_holey)
+					for (Offset i = first; i < last; ++i)
+						forget_hole(_values[i]);
+				_values.erase(_values.begin() + first, _values.begin() + last);
+				pack_filled();
+				break;
+		}
+	}
+
+	void Array::clear()
+	{
+		reset(Storage::Integer);
+	}
+
+	bool Array::pack()
+	{
+		if (_storage != Storage::Generic)
+			return true;
+		if (_values.empty())
+			return reset(Storage::Integer), true;
+
+		Storage storage = storage_of(_values.front());
+		if (storage == Storage::Generic)
+			return false;
+		for (const Value& value : _values)
+			if (storage_of(value) != storage)
+				return false;
+
+		std::vector<Value> values = std::move(_values);
+		reset(storage);
+		for (const Value& value : values)
+			push_back(value);
+		return true;
+	}
+
+	namespace
+	{
+		bool same_value(const Value& left, const Value& right)
+		{
+			if (left.type() != right.type())
+				return false;
+
+			switch (left.type())
+			{
+				case DataType::Undefined: return true;
+				case DataType::Integer: return left.integer() == right.integer();
+				case DataType::Real: return left.real() == right.real();
+				case DataType::Boolean: return left.boolean() == right.boolean();
+				case DataType::String: return left.string() == right.string();
+				case DataType::Array: return &left.array() == &right.array();
+				case DataType::Object: return &left.object() == &right.object();
+				case DataType::Function: return &left.function() == &right.function();
+				case DataType::Userdata: return &left.userdata() == &right.userdata();
+				default: return false;
+			}
+		}
+
+		inline bool is_number(const Value& value)
+		{
+			return value.type() == DataType::Integer || value.type() == DataType::Real;
+		}
+
+		inline Real as_real(const Value& value)
+		{
+			return value.type() == DataType::Integer ? static_cast<Real>(value.integer()) : value.real();
+		}
+
+		/* Exact Integer sum: the running sum wraps and the wraps are counted, the total is an Integer if none is left */
+		struct IntegerSum
+		{
+			Integer wrapped = 0;
+			Integer carries = 0;
+
+			inline void add(Integer value)
+			{
+				if (utils::add_overflow(wrapped, value, &wrapped))
+					carries += value < 0 ? -1 : 1;
+			}
+
+			inline bool fits() const { return carries == 0; }
+			inline Real real() const { return static_cast<Real>(carries) * 18446744073709551616.0 + static_cast<Real>(wrapped); }
+			inline Value value() const { return fits() ? Value(wrapped) : Value(real()); }
+		};
+	}
+
+	bool Array::sum(Value& result) const
+	{
+		const simd::Kernels& kernels = simd::kernels();
+		switch (_storage)
+		{
+			case Storage::Integer: {
+				Integer total;
+				if (!kernels.sum_integer(_integers.data(), _integers.size(), &total))
+				{
+					result = total;
+					return true;
+				}
+
+				/* A partial sum overflowed but the total may still fit, count the wraps in order */
+				IntegerSum sum;
+				for (Integer value : _integers)
+					sum.add(value);
+				result = sum.value();
+				return true;
+			}
+
+			case Storage::Real:
+				result = kernels.sum_real(_reals.data(), _reals.size());
+				return true;
+
+			case Storage::Boolean:
+				result = static_cast<Integer>(kernels.count_true(_booleans.data(), _booleans.size()));
+				return true;
+
+			default:
+				break;
+		}
+
+		IntegerSum integer;
+		Real real = 0;
+		bool isReal = false;
+		for (const Value& value : _values)
+		{
+			if (!is_number(value))
+				return false;
+			if (value.type() == DataType::Real && !isReal)
+			{
+				real = integer.real();
+				isReal = true;
+			}
+
+			if (isReal)
+				real += as_real(value);
+			else
+				integer.add(value.integer());
+		}
+
+		result = isReal ? Value(real) : integer.value();
+		return true;
+	}
+
+	template<bool _Max>
+	bool Array::reduce_extreme(Value& result) const
+	{
+		const simd::Kernels& kernels = simd::kernels();
+		if (empty())
+		{
+			result = nullptr;
+			return true;
+		}
+
+		switch (_storage)
+		{
+			case Storage::Integer:
+				result = _Max ? kernels.max_integer(_integers.data(), _integers.size()) : kernels.min_integer(_integers.data(), _integers.size());
+				return true;
+
+			case Storage::Real:
+				result = _Max ? kernels.max_real(_reals.data(), _reals.size()) : kernels.min_real(_reals.data(), _reals.size());
+				return true;
+
+			case Storage::Boolean:
+				return false;
+
+			default:
+				break;
+		}
+
+		Value best;
+		for (const Value& value : _values)
+		{
+			if (!is_number(value))
+				return false;
+			if (value.type() == DataType::Real && value.real() != value.real())
+			{
+				result = value;
+				return true;
+			}
+
+			if (best.type() == DataType::Undefined)
+				best = value;
+			else if (value.type() == DataType::Integer && best.type() == DataType::Integer)
+			{
+				if (_Max ? value.integer() > best.integer() : value.integer() < best.integer())
+					best = value;
+			}
+			else if (_Max ? as_real(value) > as_real(best) : as_real(value) < as_real(best))
+				best = value;
+		}
+
+		result = best;
+		return true;
+	}
+
+	bool Array::min(Value& result) const { return reduce_extreme<false>(result); }
+	bool Array::max(Value& result) const { return reduce_extreme<true>(result); }
+
+	template<typename _IntegerOp, typename _RealOp>
+	bool Array::assign_elementwise(const Array& left, const Array& right, _IntegerOp integerOp, _RealOp realOp)
+	{
+		Size len = left.size();
+		if (right.size() != len)
+			return false;
+
+		if (left._storage == right._storage && (left._storage == Storage::Integer || left._storage == Storage::Real))
+		{
+			std::vector<Integer> integers;
+			std::vector<Real> reals;
+			bool overflow = false;
+			if (left._storage == Storage::Integer)
+			{
+				integers.resize(len);
+				overflow = integerOp(integers.data(), left._integers.data(), right._integers.data(), len);
+			}
+			else
+			{
+				reals.resize(len);
+				realOp(reals.data(), left._reals.data(), right._reals.data(), len);
+			}
+
+			/* An overflowed element becomes a Real, like the result of the opcode: redo it element by element */
+			if (!overflow)
+			{
+				reset(left._storage);
+				if (_storage == Storage::Integer)
+					_integers = std::move(integers);
+				else
+					_reals = std::move(reals);
+				return true;
+			}
+		}
+
+		std::vector<Value> values;
+		values.reserve(len);
+		for (Offset i = 0; i < len; ++i)
+		{
+			Value a = left.get(i), b = right.get(i);
+			if (!is_number(a) || !is_number(b))
+				return false;
+
+			if (a.type() == DataType::Integer && b.type() == DataType::Integer)
+			{
+				Integer x = a.integer(), y = b.integer(), r;
+				if (!integerOp(&r, &x, &y, 1))
+				{
+					values.push_back(r);
+					continue;
+				}
+			}
+
+			Real x = as_real(a), y = as_real(b), r;
+			realOp(&r, &x, &y, 1);
+			values.push_back(r);
+		}
+
+		clear();
+		for (const Value& value : values)
+			push_back(value);
+		return true;
+	}
+
+	bool Array::assign_add(const Array& left, const Array& right)
+	{
+		const simd::Kernels& kernels = simd::kernels();
+		return assign_elementwise(left, right, kernels.add_integer, kernels.add_real);
+	}
+
+	bool Array::assign_mul(const Array& left, const Array& right)
+	{
+		const simd::Kernels& kernels = simd::kernels();
+		return assign_elementwise(left, right, kernels.mul_integer, kernels.mul_real);
+	}
+
+	void Array::assign_slice(const Array& source, Offset first, Offset last)
+	{
+		last = std::min(last, source.size());
+		first = std::min(first, last);
+
+		if (&source == this)
+		{
+			erase(last, size());
+			erase(0, first);
+			return;
+		}
+
+		reset(source._storage);
+		switch (_storage)
+		{
+			case Storage::Integer: _integers.assign(source._integers.begin() + first, source._integers.begin() + last); break;
+			case Storage::Real: _reals.assign(source._reals.begin() + first, source._reals.begin() + last); break;
+			case Storage::Boolean: _booleans.assign(source._booleans.begin() + first, source._booleans.begin() + last); break;
+			default: _values.assign(source._values.begin() + first, source._values.begin() + last); break;
+		}
+	}
+
+	void Array::fill(const Value& value)
+	{
+		if (empty())
+			return;
+		if (_storage != storage_of(value))
+		{
+			Size len = size();
+			clear();
+			resize(len, value);
+			return;
+		}
+
+		const simd::Kernels& kernels = simd::kernels();
+		switch (_storage)
+		{
+			case Storage::Integer: kernels.fill_integer(_integers.data(), _integers.size(), value.integer()); break;
+			case Storage::Real: kernels.fill_real(_reals.data(), _reals.size(), value.real()); break;
+			case Storage::Boolean: std::fill(_booleans.begin(), _booleans.end(), value.boolean()); break;
+			default:
+				std::fill(_values.begin(), _values.end(), value);
+				_holey = value.type() == DataType::Undefined;
+				_holes = _holey ? _values.size() : 0;
+				break;
+		}
+	}
+
+	Integer Array::indexOf(const Value& value) const
+	{
+		const simd::Kernels& kernels = simd::kernels();
+		Offset index = size();
+		switch (_storage)
+		{
+			case Storage::Integer:
+				if (value.type() == DataType::Integer)
+					index = kernels.index_of_integer(_integers.data(), _integers.size(), value.integer());
+				break;
+
+			case Storage::Real:
+				if (value.type() == DataType::Real)
+					index = kernels.index_of_real(_reals.data(), _reals.size(), value.real());
+				break;
+
+			case Storage::Boolean:
+				if (value.type() == DataType::Boolean)
+					index = std::find(_booleans.begin(), _booleans.end(), static_cast<UInt8>(value.boolean())) - _booleans.begin();
+				break;
+
+			default:
+				index = std::find_if(_values.begin(), _values.end(), [&value](const Value& element) { return same_value(element, value); }) - _values.begin();
+				break;
+		}
+
+		return index < size() ? static_cast<Integer>(index) : -1;
+	}
+
+	bool Array::equals(const Array& right) const
+	{
+		Size len = size();
+		if (right.size() != len)
+			return false;
+		if (len == 0)
+			return true;
+
+		if (_storage == right._storage)
+		{
+			switch (_storage)
+			{
+				case Storage::Integer: return std::memcmp(_integers.data(), right._integers.data(), len * sizeof(Integer)) == 0;
+				case Storage::Real: return simd::kernels().equal_real(_reals.data(), right._reals.data(), len);
+				case Storage::Boolean: return std::memcmp(_booleans.data(), right._booleans.data(), len) == 0;
+				default: break;
+			}
+		}
+
+		for (Offset i = 0; i < len; ++i)
+			if (!same_value(get(i), right.get(i)))
+				return false;
+		return true;
+	}
+
+	Array::Storage Array::storage_of(const Value& value)
+	{
+		switch (value.type())
+		{
+			case DataType::Integer: return Storage::Integer;
+			case DataType::Real: return Storage::Real;
+			case DataType::Boolean: return Storage::Boolean;
+			default: return Storage::Generic;
+		}
+	}
+
+	void Array::prepare(const Value& value)
+	{
+		if (accepts(value))
+			return;
+
+		if (empty())
+		{
+			reset(storage_of(value));
+			_holey = value.type() == DataType::Undefined;
+		}
+		else
+			make_generic(value.type() == DataType::Undefined);
+	}
+
+	void Array::make_generic(bool holey)
+	{
+		if (_storage == Storage::Generic)
+			return;
+
+		std::vector<Value> values;
+		values.reserve(size());
+		for (Offset i = 0, len = size(); i < len; ++i)
+			values.push_back(get(i));
+
+		reset(Storage::Generic);
+		_values = std::move(values);
+		_holey = holey;
+	}
+
+	void Array::pack_filled()
+	{
+		if (_holey && _holes == 0 && !_values.empty())
+		{
+			_holey = false;
+			pack();
+		}
+	}
+
+	void Array::set_hole(Offset index, const Value& value)
+	{
+		forget_hole(_values[index]);
+		record_hole(value);
+		_values[index] = value;
+		pack_filled();
+	}
+
+	void Array::reset(Storage storage)
+	{
+		switch (_storage)
+		{
+			case Storage::Integer: std::destroy_at(&_integers); break;
+			case Storage::Real: std::destroy_at(&_reals); break;
+			case Storage::Boolean: std::destroy_at(&_booleans); break;
+			default: std::destroy_at(&_values); break;
+		}
+
+		_storage = storage;
+		_holey = false;
+		_holes = 0;
+		switch (_storage)
+		{
+			case Storage::Integer: std::construct_at(&_integers); break;
+			case Storage::Real: std::construct_at(&_reals); break;
+			case Storage::Boolean: std::construct_at(&_booleans); break;
+			default: std::construct_at(&_values); break;
+		}
+	}
+
+	void Array::traverse(mem::BlockVisitor& visitor)
+	{
+		if (_storage != Storage::Generic)
+			return;
+
+		for (const Value& value : _values)
+			visitor(value);
+	}
+
+
+
+	Shape* Shape::transition(const std::string& name, bool isConst)
+	{
+		auto it = _transitions.find(std::make_pair(name, isConst));
+		if (it != _transitions.end())
+			return it->second.get();
+
+		Shape* child = new Shape(this, name, isConst);
+		_transitions.emplace(std::make_pair(name, isConst), std::unique_ptr<Shape>(child));
+		return child;
+	}
+
+	std::shared_ptr<Shape::Descriptors> Shape::copy_descriptors() const
+	{
+		auto descriptors = std::make_shared<Descriptors>();
+		descriptors->properties.reserve(_size + 1);
+		for (Offset i = 0; i < _size; ++i)
+		{
+			descriptors->properties.push_back(_descriptors->properties[i]);
+			descriptors->indices.emplace(_descriptors->properties[i].first, i);
+		}
+		return descriptors;
+	}
+
+	void Shape::append(const std::string& name, bool isConst)
+	{
+		Offset index = _descriptors->properties.size();
+		_descriptors->properties.push_back({ name, Slot{ index, isConst } });
+		_descriptors->indices.emplace(name, index);
+	}
+
+	Shape* Shape::dictionary(const Shape& shape)
+	{
+		Shape* dictionary = new Shape(shape._concurrent);
+		dictionary->_dictionary = true;
+		dictionary->_size = shape._size;
+		dictionary->_descriptors = shape.copy_descriptors();
+		return dictionary;
+	}
+
 
 
-	Object::Object(const Value& value, ConstructType type) :
+	Object::Object(Shape& shape) :
 		MemoryBlock(),
-		_props(),
-		_parent(type == ConstructType::Parent ? value : nullptr),
-		_class(type == ConstructType::Class ? value : nullptr)
+		_shape(&shape),
+		_slots(),
+		_parent(),
+		_class()
 	{}
-	Object::Object(const std::unordered_map<std::string, Property>& props, const Value& value, ConstructType type) :
+	Object::Object(Shape& shape, const Value& value, ConstructType type) :
 		MemoryBlock(),
-		_props(props),
+		_shape(&shape),
+		_slots(),
 		_parent(type == ConstructType::Parent ? value : nullptr),
 		_class(type == ConstructType::Class ? value : nullptr)
 	{}
-	Object::Object(const std::unordered_map<std::string, Property>& props) :
-		MemoryBlock(),
-		_props(props),
-		_parent(),
-		_class()
-	{}
 
-	Object::Property* Object::getProperty(const std::string& name)
+	Object::~Object()
+	{
+		if (_shape->isDictionary())
+			delete _shape;
+	}
+
+	Object::Property Object::getProperty(const std::string& name)
+	{
+		const Shape::Slot* slot = _shape->find(name);
+		return slot ? Property(&_slots[slot->index], slot->isConst) : Property();
+	}
+	const Object::Property Object::getProperty(const std::string& name) const
+	{
+		const Shape::Slot* slot = _shape->find(name);
+		return slot ? Property(const_cast<Value*>(&_slots[slot->index]), slot->isConst) : Property();
+	}
+
+	Object::Property Object::getProperty(const String& name)
+	{
+		const Shape::Slot* slot = _shape->find(name);
+		return slot ? Property(&_slots[slot->index], slot->isConst) : Property();
+	}
+	const Object::Property Object::getProperty(const String& name) const
+	{
+		const Shape::Slot* slot = _shape->find(name);
+		return slot ? Property(const_cast<Value*>(&_slots[slot->index]), slot->isConst) : Property();
+	}
+
+	Value& Object::operator[] (const std::string& name)
+	{
+		const Shape::Slot* slot = _shape->find(name);
+		if (!slot)
+			throw std::out_of_range("undefined property '" + name + "'");
+		return _slots[slot->index];
+	}
+	const Value& Object::operator[] (const std::string& name) const
 	{
-		const auto& it = _props.find(name);
-		if (it == _props.end())
-			return nullptr;
-		return &it->second;
+		const Shape::Slot* slot = _shape->find(name);
+		if (!slot)
+			throw std::out_of_range("undefined property '" + name + "'");
+		return _slots[slot->index];
 	}
-	const Object::Property* Object::getProperty(const std::string& name) const
+
+	void Object::traverse(mem::BlockVisitor& visitor)
 	{
-		const auto& it = _props.find(name);
-		if (it == _props.end())
-			return nullptr;
-		return &it->second;
+		for (const Value& value : _slots)
+			visitor(value);
+
+		visitor(_parent);
+		visitor(_class);
 	}
 
 	bool Object::insert(const std::string& name, const Value& value, bool isConst)
 	{
-		auto result = _props.emplace(
-			std::piecewise_construct,
-			std::forward_as_tuple(name),
-			std::forward_as_tuple(value, isConst)
-		);
+		if (isFrozen() || _shape->find(name))
+			return false;
 
-		return result.second;
+		add_property(name, isConst, value);
+		return true;
+	}
+
+	void Object::add_property(const std::string& name, bool isConst, const Value& value)
+	{
+		if (_shape->isDictionary())
+			_shape->add(name, isConst);
+		else if (_shape->overflows(name, isConst))
+		{
+			_shape = Shape::dictionary(*_shape);
+			_shape->add(name, isConst);
+		}
+		else
+			_shape = _shape->transition(name, isConst);
+		_slots.push_back(value);
+	}
+
+	void Object::reset_shape(Shape& root)
+	{
+		if (_shape->isDictionary())
+			delete _shape;
+		_shape = &root;
 	}
 
 
@@ -92,25 +857,67 @@ namespace k::data
 	Function::Function(const Chunk& chunk, Size upsCount, const std::string& name) :
 		MemoryBlock(),
 		_name(name),
-		_callable(new Callable(chunk, upsCount))
+		_callable(new Callable(chunk, upsCount, &_name))
 	{}
 
+	Function::Function(NativeFunction native, const std::string& name, const void* data, Size dataSize) :
+		MemoryBlock(),
+		_name(name),
+		_callable(nullptr),
+		_native(native)
+	{
+		if (dataSize > native_data_size)
+			throw std::invalid_argument("native function data too large");
+		if (data)
+			std::memcpy(_nativeData, data, dataSize);
+	}
+
 	Function::~Function()
 	{
 		if (_callable)
 			delete _callable;
 	}
 
-	void Function::call(runtime::RuntimeState& state, const Value* args, Size argsCount)
+	void Function::traverse(mem::BlockVisitor& visitor)
 	{
-		runtime::execute(state, *_callable, args, argsCount);
+		if (_callable)
+			_callable->traverse(visitor);
+	}
+
+	Value Function::call(runtime::RuntimeState& state, const Value* args, Size argsCount)
+	{
+		return invoke(state, Value(), args, argsCount);
+	}
+	Value Function::call(runtime::RuntimeState& state, std::initializer_list<Value> args)
+	{
+		return invoke(state, Value(), args.begin(), args.size());
+	}
+	Value Function::call(runtime::RuntimeState& state, const std::vector<Value>& args)
+	{
+		return invoke(state, Value(), args.data(), args.size());
 	}
-	/*void Function::call(runtime::RuntimeState& state, std::initializer_list<Value> args);
-	void Function::call(runtime::RuntimeState& state, const std::vector<Value>& args);
 
-	void Function::invoke(runtime::RuntimeState& state, const Value& self, const Value* args, Size argsCount);
-	void Function::invoke(runtime::RuntimeState& state, const Value& self, std::initializer_list<Value> args);
-	void Function::invoke(runtime::RuntimeState& state, const Value& self, const std::vector<Value>& args);*/
+	Value Function::invoke(runtime::RuntimeState& state, const Value& self, const Value* args, Size argsCount)
+	{
+		if (!_native)
+		{
+			Value function = this;
+			return runtime::execute(state, *_callable, &self, args, argsCount, &function);
+		}
+
+		Value result;
+		if (!_native(state, *this, self, args, argsCount, result))
+			return Value();
+		return result;
+	}
+	Value Function::invoke(runtime::RuntimeState& state, const Value& self, std::initializer_list<Value> args)
+	{
+		return invoke(state, self, args.begin(), args.size());
+	}
+	Value Function::invoke(runtime::RuntimeState& state, const Value& self, const std::vector<Value>& args)
+	{
+		return invoke(state, self, args.data(), args.size());
+	}
 }
 
 namespace k::mem
@@ -122,58 +929,597 @@ namespace k::mem
 
 	Heap::~Heap()
 	{
+		_interned.clear();
+
+		/* Detach every block first so the destructors' dec_ref cascades cannot free blocks under the walk */
+		for (MemoryBlock* block = _front; block; block = block->_next)
+			block->_owner = nullptr;
+
+		/* Slab storage is reclaimed page by page when _slabs is destroyed, only large blocks are freed one by one */
 		for (MemoryBlock* block = _front, *next; block; block = next)
 		{
 			next = block->_next;
+			bool large = block->_sizeClass == SlabAllocator::large_class;
 			utils::destroy(*block);
-			utils::free(block);
+			if (large)
+				utils::free(block);
 		}
 
 		_front = _back = nullptr;
+
+		for (RootSet* roots : _rootSets)
+			std::erase(roots->_heaps, this);
 	}
 
 	void Heap::deallocate(MemoryBlock* block)
 	{
 		if (block->_owner == this)
 		{
-			if (block->_next)
-				block->_next->_prev = block->_prev;
-			if (block->_prev)
-				block->_prev->_next = block->_next;
+			unlink(block);
+			release(block);
+		}
+	}
+
+	data::Value Heap::intern(std::string_view str)
+	{
+		const auto& it = _interned.find(str);
+		if (it != _interned.end())
+			return it->second;
+
+		data::String* string = allocate<data::String>(str);
+		string->_flags |= MemoryBlock::flag_interned;
+		string->_hash = std::hash<std::string_view>()(*string);
 
-			if (block->_owner->_front == block)
-				block->_owner->_front = block->_next;
-			if (block->_owner->_back == block)
-				block->_owner->_back = block->_prev;
+		/* The key views the block's own buffer, which never moves because interned strings are immutable */
+		_interned.emplace(*string, string);
+		return string;
+	}
+
+	data::Value Heap::concat(const data::Value& left, const data::Value& right)
+	{
+		const data::String& first = left.string();
+		const data::String& second = right.string();
 
-			utils::destroy(block);
+		if (second.empty())
+			return left;
+		if (first.empty())
+			return right;
+
+		Size size = first.size() + second.size();
+		if (size >= data::String::rope_min_size)
+			return allocate<data::String>(left, right);
+
+		std::string buffer;
+		buffer.reserve(size);
+		buffer.append(first.view()).append(second.view());
+		return allocate<data::String>(std::string_view(buffer));
+	}
+
+	void Heap::attach(RootSet& roots)
+	{
+		if (std::find(_rootSets.begin(), _rootSets.end(), &roots) == _rootSets.end())
+		{
+			_rootSets.push_back(&roots);
+			roots._heaps.push_back(this);
+		}
+	}
+
+	void Heap::detach(RootSet& roots)
+	{
+#if K_DEFERRED_RC
+		/* A root set can go away during a collection, e.g. the stacks of a Fiber found to be garbage */
+		if (_rootsPinned && std::find(_rootSets.begin(), _rootSets.end(), &roots) != _rootSets.end())
+			unpin(roots);
+#endif
+		std::erase(_rootSets, &roots);
+		std::erase(roots._heaps, this);
+	}
+
+	RootSet::~RootSet()
+	{
+		detach_all();
+	}
+
+	void RootSet::detach_all()
+	{
+		while (!_heaps.empty())
+			_heaps.back()->detach(*this);
+	}
+
+	void Heap::unlink(MemoryBlock* block)
+	{
+		if (block->_next)
+			block->_next->_prev = block->_prev;
+		if (block->_prev)
+			block->_prev->_next = block->_next;
+
+		if (_front == block)
+			_front = block->_next;
+		if (_back == block)
+			_back = block->_prev;
+
+		block->_next = block->_prev = nullptr;
+	}
+
+	void Heap::release(MemoryBlock* block)
+	{
+		if (block->_flags & MemoryBlock::flag_interned)
+			_interned.erase(*static_cast<data::String*>(block));
+
+		UInt8 sizeClass = block->_sizeClass;
+		utils::destroy(*block);
+
+		if (sizeClass == SlabAllocator::large_class)
 			utils::free(block);
+		else
+			_slabs.deallocate(block);
+	}
+
+	template<typename _Ty>
+	void Heap::for_each_child(MemoryBlock* block, _Ty&& action)
+	{
+		struct Visitor : BlockVisitor
+		{
+			Heap* heap;
+			_Ty* action;
+
+			void visit(MemoryBlock* child) override
+			{
+				if (child->_owner == heap && !(child->_flags & MemoryBlock::flag_acyclic))
+					(*action)(child);
+			}
+		} visitor;
+
+		visitor.heap = this;
+		visitor.action = &action;
+		block->traverse(visitor);
+	}
+
+	void Heap::drain_roots(std::vector<MemoryBlock*>& candidates)
+	{
+		/*
+		 * Free the buffered blocks whose count already dropped to zero. Their cascades may zero
+		 * other buffered blocks or buffer new ones, so repeat until nothing is freed.
+		 */
+		for (bool freed = true; freed;)
+		{
+			freed = false;
+			candidates.insert(candidates.end(), _roots.begin(), _roots.end());
+			_roots.clear();
+
+			for (MemoryBlock*& block : candidates)
+			{
+				if (block && block->_refs == 0)
+				{
+					block->_flags &= ~MemoryBlock::flag_buffered;
+#if K_DEFERRED_RC
+					if (!(block->_flags & MemoryBlock::flag_zct))
+						zero_count(block);
+					block = nullptr;
+#else
+					deallocate(std::exchange(block, nullptr));
+					freed = true;
+#endif
+				}
+			}
+		}
+	}
+
+	void Heap::purge_roots()
+	{
+#if K_DEFERRED_RC
+		reconcile();
+#endif
+
+		/* Only the blocks still purple can be part of a garbage cycle, they stay buffered for collect_cycles */
+		std::vector<MemoryBlock*> candidates;
+		drain_roots(candidates);
+		for (MemoryBlock* block : candidates)
+		{
+			if (!block)
+				continue;
+
+			if (block->_color == MemoryBlock::Color::Purple)
+				_roots.push_back(block);
+			else
+				block->_flags &= ~MemoryBlock::flag_buffered;
+		}
+
+		/* Live candidates are purged again once the buffer doubles, not on every allocation */
+		_rootsTrigger = std::max(_rootsLimit, _roots.size() * 2);
+	}
+
+	void Heap::collect_cycles()
+	{
+		_allocationsSinceCollect = 0;
+		auto start = std::chrono::steady_clock::now();
+
+#if K_DEFERRED_RC
+		/* Stack slots are uncounted: purge stale zero-count entries first, this may also buffer new candidates */
+		reconcile();
+#endif
+
+		if (_roots.empty())
+			return;
+
+#if K_DEFERRED_RC
+		/* Count every stack reference for the duration of the collection so those blocks act as external roots */
+		pin_roots();
+#endif
+
+		/* The trial deletion below must not observe real frees while counts are trial-decremented */
+		std::vector<MemoryBlock*> candidates;
+		drain_roots(candidates);
+		_rootsTrigger = _rootsLimit;
+
+		Size count = 0;
+		for (MemoryBlock* block : candidates)
+		{
+			if (!block)
+				continue;
+
+			if (block->_color == MemoryBlock::Color::Purple)
+			{
+				mark_gray(block);
+				candidates[count++] = block;
+			}
+			else
+				block->_flags &= ~MemoryBlock::flag_buffered;
+		}
+		candidates.resize(count);
+
+		for (MemoryBlock* block : candidates)
+			scan(block);
+
+		std::vector<MemoryBlock*> garbage;
+		for (MemoryBlock* block : candidates)
+		{
+			block->_flags &= ~MemoryBlock::flag_buffered;
+			collect_white(block, garbage);
+		}
+
+		/*
+		 * Flag the garbage as buffered (and zero-counted) so the destructors' dec_ref calls between members
+		 * of the same cycle neither free nor re-buffer them; storage is released once all are destroyed.
+		 */
+		for (MemoryBlock* block : garbage)
+		{
+			block->_flags |= MemoryBlock::flag_buffered | MemoryBlock::flag_zct;
+			block->_color = MemoryBlock::Color::White;
+			unlink(block);
+		}
+
+		/*
+		 * Live children of the garbage already lost the trial decrement of those references, undo it
+		 * so the dec_ref calls performed by the garbage destructors do not count them twice.
+		 */
+		for (MemoryBlock* block : garbage)
+		{
+			for_each_child(block, [](MemoryBlock* child) {
+				if (child->_color != MemoryBlock::Color::White)
+					++child->_refs;
+			});
+		}
+
+		std::vector<UInt8> sizeClasses(garbage.size());
+		for (Offset i = 0; i < garbage.size(); ++i)
+		{
+			sizeClasses[i] = garbage[i]->_sizeClass;
+			utils::destroy(*garbage[i]);
+		}
+
+		for (Offset i = 0; i < garbage.size(); ++i)
+		{
+			if (sizeClasses[i] == SlabAllocator::large_class)
+				utils::free(garbage[i]);
+			else
+				_slabs.deallocate(garbage[i]);
+		}
+
+#if K_DEFERRED_RC
+		unpin_roots();
+#endif
+
+		auto pause = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+		_cycleStats.collections++;
+		_cycleStats.freedBlocks += garbage.size();
+		_cycleStats.lastPause = pause;
+		_cycleStats.totalPause += pause;
+		_cycleStats.maxPause = std::max(_cycleStats.maxPause, pause);
+	}
+
+	void Heap::mark_roots(UInt8 flag)
+	{
+		struct Visitor : BlockVisitor
+		{
+			Heap* heap;
+			UInt8 flag;
+
+			void visit(MemoryBlock* block) override
+			{
+				if (block->_owner == heap)
+					block->_flags |= flag;
+			}
+		} visitor;
+
+		visitor.heap = this;
+		visitor.flag = flag;
+		for (RootSet* roots : _rootSets)
+			roots->scan_roots(visitor);
+	}
+
+	void Heap::unmark_roots(UInt8 flag)
+	{
+		struct Visitor : BlockVisitor
+		{
+			Heap* heap;
+			UInt8 flag;
+
+			void visit(MemoryBlock* block) override
+			{
+				if (block->_owner == heap)
+					block->_flags &= ~flag;
+			}
+		} visitor;
+
+		visitor.heap = this;
+		visitor.flag = flag;
+		for (RootSet* roots : _rootSets)
+			roots->scan_roots(visitor);
+	}
+
+#if K_DEFERRED_RC
+	void Heap::reconcile()
+	{
+		mark_roots(MemoryBlock::flag_stack);
+
+		/* Freeing a block may zero its children, which are appended to _zct and handled in the same pass */
+		Size kept = 0;
+		for (Offset i = 0; i < _zct.size(); ++i)
+		{
+			MemoryBlock* block = _zct[i];
+			if (block->_refs == 0 && (block->_flags & MemoryBlock::flag_stack))
+			{
+				_zct[kept++] = block;
+				continue;
+			}
+
+			block->_flags &= ~MemoryBlock::flag_zct;
+			if (block->_refs == 0)
+			{
+				if (!(block->_flags & MemoryBlock::flag_buffered))
+					deallocate(block);
+				else
+					zero_buffered(block);
+			}
+			else if (!(block->_flags & MemoryBlock::flag_acyclic))
+				possible_root(block);	/* Revived by heap references only: it may have closed a cycle */
+		}
+		_zct.resize(kept);
+
+		unmark_roots(MemoryBlock::flag_stack);
+
+		/* A root set detached during the pass leaves its blocks flagged, they are checked again on the next one */
+		for (MemoryBlock* block : _zct)
+			block->_flags &= ~MemoryBlock::flag_stack;
+	}
+
+	void Heap::pin_roots()
+	{
+		struct Visitor : BlockVisitor
+		{
+			Heap* heap;
+
+			void visit(MemoryBlock* block) override
+			{
+				if (block->_owner == heap)
+					++block->_refs;
+			}
+		} visitor;
+
+		visitor.heap = this;
+		for (RootSet* roots : _rootSets)
+			roots->scan_roots(visitor);
+		_rootsPinned = true;
+	}
+
+	void Heap::unpin_roots()
+	{
+		_rootsPinned = false;
+		for (RootSet* roots : _rootSets)
+			unpin(*roots);
+	}
+
+	void Heap::unpin(RootSet& roots)
+	{
+		struct Visitor : BlockVisitor
+		{
+			Heap* heap;
+
+			void visit(MemoryBlock* block) override
+			{
+				if (block->_owner != heap)
+					return;
+
+				/* Stack references vanish without a decrement, so a stack-held block stays a cycle candidate */
+				if (--block->_refs == 0)
+				{
+					if (!(block->_flags & MemoryBlock::flag_zct))
+						heap->zero_count(block);
+				}
+				else if (!(block->_flags & MemoryBlock::flag_acyclic))
+					heap->possible_root(block);
+			}
+		} visitor;
+
+		visitor.heap = this;
+		roots.scan_roots(visitor);
+	}
+#endif
+
+	void Heap::mark_gray(MemoryBlock* root)
+	{
+		Size base = _scratch.size();
+		_scratch.push_back(root);
+
+		while (_scratch.size() > base)
+		{
+			MemoryBlock* block = _scratch.back();
+			_scratch.pop_back();
+
+			if (block->_color == MemoryBlock::Color::Gray)
+				continue;
+
+			block->_color = MemoryBlock::Color::Gray;
+			for_each_child(block, [this](MemoryBlock* child) {
+				--child->_refs;
+				_scratch.push_back(child);
+			});
+		}
+	}
+
+	void Heap::scan(MemoryBlock* root)
+	{
+		Size base = _scratch.size();
+		_scratch.push_back(root);
+
+		while (_scratch.size() > base)
+		{
+			MemoryBlock* block = _scratch.back();
+			_scratch.pop_back();
+
+			if (block->_color != MemoryBlock::Color::Gray)
+				continue;
+
+			if (block->_refs > 0)
+				scan_black(block);
+			else
+			{
+				block->_color = MemoryBlock::Color::White;
+				for_each_child(block, [this](MemoryBlock* child) { _scratch.push_back(child); });
+			}
+		}
+	}
+
+	void Heap::scan_black(MemoryBlock* root)
+	{
+		Size base = _scratch.size();
+		root->_color = MemoryBlock::Color::Black;
+		_scratch.push_back(root);
+
+		while (_scratch.size() > base)
+		{
+			MemoryBlock* block = _scratch.back();
+			_scratch.pop_back();
+
+			for_each_child(block, [this](MemoryBlock* child) {
+				++child->_refs;
+				if (child->_color != MemoryBlock::Color::Black)
+				{
+					child->_color = MemoryBlock::Color::Black;
+					_scratch.push_back(child);
+				}
+			});
+		}
+	}
+
+	void Heap::collect_white(MemoryBlock* root, std::vector<MemoryBlock*>& garbage)
+	{
+		Size base = _scratch.size();
+		_scratch.push_back(root);
+
+		while (_scratch.size() > base)
+		{
+			MemoryBlock* block = _scratch.back();
+			_scratch.pop_back();
+
+			if (block->_color != MemoryBlock::Color::White || (block->_flags & MemoryBlock::flag_buffered))
+				continue;
+
+			block->_color = MemoryBlock::Color::Black;
+			garbage.push_back(block);
+			for_each_child(block, [this](MemoryBlock* child) { _scratch.push_back(child); });
 		}
 	}
 }
 
 namespace k::data
 {
-	Integer Value::runtime_cast_integer(runtime::RuntimeState& state) const
+	namespace
+	{
+		Integer cast_error(runtime::RuntimeState& state, mem::Heap& heap, DataType type, const char* target)
+		{
+			static constexpr const char* names[] = { "Undefined", "Integer", "Real", "Boolean", "String", "Array", "Object", "Function", "Userdata" };
+			state.setError(heap.intern(std::string("cannot convert ") + names[static_cast<int>(type)] + " to " + target));
+			return 0;
+		}
+	}
+
+	Integer Value::runtime_cast_integer(runtime::RuntimeState& state, mem::Heap& heap) const
 	{
-		switch (_type)
+		switch (type())
 		{
 			case DataType::Undefined: return 0;
-			case DataType::Integer: return _data.integer;
-			case DataType::Real: return static_cast<Integer>(_data.real);
-			case DataType::Boolean: return static_cast<Integer>(_data.boolean);
+			case DataType::Integer: return integer();
+			case DataType::Boolean: return static_cast<Integer>(boolean());
+
+			case DataType::Real:
+				/* Out of range, NaN included, has no Integer value */
+				if (!(real() >= -9223372036854775808.0 && real() < 9223372036854775808.0))
+				{
+					state.setError(heap.intern("Real out of the Integer range"));
+					return 0;
+				}
+				return static_cast<Integer>(real());
+
+			case DataType::String:
+			case DataType::Array:
+			case DataType::Object:
+			case DataType::Function:
+			case DataType::Userdata:
+				return cast_error(state, heap, type(), "Integer");
 		}
 
-		return 0;
+		K_UNREACHABLE();
 	}
 
-	/*Real Value::runtime_cast_real(runtime::RuntimeState& state) const
+	Real Value::runtime_cast_real(runtime::RuntimeState& state, mem::Heap& heap) const
 	{
+		switch (type())
+		{
+			case DataType::Undefined: return 0;
+			case DataType::Integer: return static_cast<Real>(integer());
+			case DataType::Real: return real();
+			case DataType::Boolean: return boolean() ? 1 : 0;
+
+			case DataType::String:
+			case DataType::Array:
+			case DataType::Object:
+			case DataType::Function:
+			case DataType::Userdata:
+				return static_cast<Real>(cast_error(state, heap, type(), "Real"));
+		}
 
+		K_UNREACHABLE();
 	}
 
-	Boolean Value::runtime_cast_boolean(runtime::RuntimeState& state) const
+	Boolean Value::runtime_cast_boolean(runtime::RuntimeState&) const
 	{
+		switch (type())
+		{
+			case DataType::Undefined: return false;
+			case DataType::Integer: return integer() != 0;
+			case DataType::Real: return real() != 0;
+			case DataType::Boolean: return boolean();
+			case DataType::String: return !string().empty();
 
-	}*/
+			case DataType::Array:
+			case DataType::Object:
+			case DataType::Function:
+			case DataType::Userdata:
+				return true;
+		}
+
+		K_UNREACHABLE();
+	}
 }
@@ -0,0 +1,74 @@
+#include "fiber.h"
+
+namespace k::runtime
+{
+	Fiber::Fiber(data::Function& function, Size valueCapacity) :
+		_state(valueCapacity, CallStack::default_count),
+		_function(function),
+		_status(Status::Created)
+	{
+		_state._fiber = this;
+	}
+
+	data::Value Fiber::resume(RuntimeState& caller, const data::Value* args, Size argsCount)
+	{
+		data::Function& function = this->function();
+		if (_status == Status::Running || _status == Status::Dead)
+		{
+			caller.setError(function.owner()->intern(_status == Status::Running ? "resume of a running fiber" : "resume of a dead fiber"));
+			return data::Value();
+		}
+
+#if K_PROFILER
+		/* The fiber stacks are profiled on their own, without the frames of the resumer */
+		_state._profiler = caller._profiler;
+#endif
+
+		data::Value result;
+		if (std::exchange(_status, Status::Running) == Status::Created)
+		{
+			if (function.isNative())
+			{
+				/* A native entry cannot be suspended, the marker keeps the scripts it calls from yielding */
+				_state._calls.pushNative();
+				result = function.invoke(_state, data::Value(), args, argsCount);
+				_state._calls.pop();
+			}
+			else
+				result = execute(_state, function.callable(), nullptr, args, argsCount, &_function);
+		}
+		else
+			result = runtime::resume(_state, argsCount > 0 ? args[0] : data::Value());
+
+		if (_state.hasError())
+		{
+			caller.setError(_state.getError());
+			_state.clearError();
+			_status = Status::Dead;
+			return data::Value();
+		}
+
+		_status = _state.isSuspended() ? Status::Suspended : Status::Dead;
+		return result;
+	}
+	data::Value Fiber::resume(RuntimeState& caller, std::initializer_list<data::Value> args)
+	{
+		return resume(caller, args.begin(), args.size());
+	}
+
+	void Fiber::traverse(mem::BlockVisitor& visitor)
+	{
+		visitor(_function);
+#if K_DEFERRED_RC
+		/* Stack slots are uncounted, the stacks are a root set: a fiber only reachable from them is never collected */
+#else
+		/* Stack slots hold counted references, they are children of the Fiber like the values of an Array */
+		_state._values.scan_roots(visitor);
+#endif
+	}
+
+	data::Value Fiber::create(mem::Heap& heap, data::Function& function, Size valueCapacity)
+	{
+		return heap.create_userdata<Fiber>(function, valueCapacity);
+	}
+}
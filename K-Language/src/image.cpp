@@ -0,0 +1,268 @@
+#include "image.h"
+#include "verifier.h"
+
+namespace k::image
+{
+	namespace
+	{
+		constexpr UInt64 align(UInt64 offset) { return (offset + alignment - 1) / alignment * alignment; }
+
+		[[noreturn]] void reject(const std::string& msg)
+		{
+			throw error::BytecodeError("invalid chunk image: " + msg);
+		}
+
+		ConstantRecord make_record(const data::Value& value, std::string& strings)
+		{
+			ConstantRecord record = {};
+			switch (value.type())
+			{
+				case data::DataType::Undefined:
+					record.type = static_cast<UInt32>(Chunk::Constant::Type::Undefined);
+					break;
+
+				case data::DataType::Integer:
+					record.type = static_cast<UInt32>(Chunk::Constant::Type::Integer);
+					record.integer = value.integer();
+					break;
+
+				case data::DataType::Real:
+					record.type = static_cast<UInt32>(Chunk::Constant::Type::Real);
+					record.real = value.real();
+					break;
+
+				case data::DataType::Boolean:
+					record.type = static_cast<UInt32>(Chunk::Constant::Type::Boolean);
+					record.boolean = value.boolean();
+					break;
+
+				case data::DataType::String:
+					record.type = static_cast<UInt32>(Chunk::Constant::Type::String);
+					record.stringOffset = strings.size();
+					record.stringSize = static_cast<UInt32>(value.string().size());
+					strings.append(value.string());
+					break;
+
+				default:
+					throw error::BytecodeError("chunk constant has no image representation");
+			}
+			return record;
+		}
+	}
+
+	void write(std::ostream& out, const Chunk& root)
+	{
+		/* Breadth-first, so the children of every chunk are contiguous records */
+		std::vector<const Chunk*> order = { &root };
+		std::vector<ChunkRecord> chunks;
+		std::vector<ConstantRecord> constants;
+		std::string strings;
+		UInt64 codeSize = 0;
+
+		/* A shared pool is written once, every chunk using it gets the same range */
+		std::unordered_map<const data::Value*, UInt64> pools;
+
+		for (Offset i = 0; i < order.size(); ++i)
+		{
+			const Chunk& chunk = *order[i];
+			chunk.materialize_constants();
+
+			ChunkRecord record = {};
+			record.firstChild = static_cast<UInt32>(order.size());
+			record.childCount = static_cast<UInt32>(chunk.chunksCount());
+			record.constantCount = static_cast<UInt32>(chunk.constantsCount());
+			record.varsCount = static_cast<UInt32>(chunk.varsCount());
+			record.tempsCount = static_cast<UInt32>(chunk.tempsCount());
+			record.propertyCachesCount = static_cast<UInt32>(chunk.propertyCachesCount());
+			record.codeOffset = codeSize;
+			record.codeSize = chunk.instructionsCount();
+			codeSize = align(codeSize + record.codeSize);
+
+			for (Offset j = 0; j < chunk.chunksCount(); ++j)
+				order.push_back(chunk.chunk(j));
+
+			if (chunk.constantsCount() > 0)
+			{
+				auto [it, inserted] = pools.try_emplace(&chunk.constant(0), constants.size());
+				record.firstConstant = it->second;
+				if (inserted)
+				{
+					for (Offset j = 0; j < chunk.constantsCount(); ++j)
+						constants.push_back(make_record(chunk.constant(j), strings));
+				}
+			}
+			chunks.push_back(record);
+		}
+
+		Header header = {};
+		std::copy(std::begin(magic), std::end(magic), header.magic);
+		header.version = version;
+		header.byteOrder = byte_order_mark;
+		header.chunkCount = static_cast<UInt32>(chunks.size());
+		header.constantCount = constants.size();
+		header.chunksOffset = sizeof(Header);
+		header.constantsOffset = header.chunksOffset + chunks.size() * sizeof(ChunkRecord);
+		header.stringsOffset = header.constantsOffset + constants.size() * sizeof(ConstantRecord);
+		header.codeOffset = align(header.stringsOffset + strings.size());
+		header.fileSize = header.codeOffset + codeSize;
+
+		static constexpr char padding[alignment] = {};
+
+		out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		out.write(reinterpret_cast<const char*>(chunks.data()), chunks.size() * sizeof(ChunkRecord));
+		out.write(reinterpret_cast<const char*>(constants.data()), constants.size() * sizeof(ConstantRecord));
+		out.write(strings.data(), strings.size());
+		out.write(padding, header.codeOffset - (header.stringsOffset + strings.size()));
+
+		for (Offset i = 0; i < order.size(); ++i)
+		{
+			out.write(reinterpret_cast<const char*>(order[i]->instructionData()), chunks[i].codeSize);
+			out.write(padding, align(chunks[i].codeSize) - chunks[i].codeSize);
+		}
+	}
+
+	void MappedImage::load(const std::string& path, mem::Heap& heap, bool verify)
+	{
+		_root = Chunk();
+		if (!_file.open(path))
+			throw error::RuntimeError("cannot map chunk image '" + path + "'");
+
+		const Byte* data = _file.data();
+		Size size = _file.size();
+
+		if (size < sizeof(Header) || reinterpret_cast<std::uintptr_t>(data) % alignment != 0)
+			reject("truncated header");
+
+		const Header& header = *reinterpret_cast<const Header*>(data);
+		if (!std::equal(std::begin(magic), std::end(magic), header.magic))
+			reject("bad magic");
+		if (header.version != version)
+			reject("unsupported version " + std::to_string(header.version));
+		if (header.byteOrder != byte_order_mark)
+			reject("foreign byte order");
+		if (header.fileSize != size || header.chunkCount == 0)
+			reject("size mismatch");
+
+		auto section = [size](UInt64 offset, UInt64 count, UInt64 itemSize) {
+			return offset % alignment == 0 && offset <= size && count <= (size - offset) / itemSize;
+		};
+		if (!section(header.chunksOffset, header.chunkCount, sizeof(ChunkRecord)) ||
+			!section(header.constantsOffset, header.constantCount, sizeof(ConstantRecord)) ||
+			header.stringsOffset > header.codeOffset || !section(header.codeOffset, 0, 1))
+		{
+			reject("section out of bounds");
+		}
+
+		check_tree(header);
+
+		/* Breadth-first like write, with an explicit worklist so that deep trees cannot overflow the native stack */
+		struct Pending
+		{
+			Chunk* chunk;
+			UInt32 index;
+			const Chunk* parent;
+		};
+		std::vector<Pending> pending = { { &_root, 0, nullptr } };
+		for (Offset i = 0; i < pending.size(); ++i)
+		{
+			Pending next = pending[i];
+			build(*next.chunk, next.index, next.parent, heap, verify);
+
+			const ChunkRecord& record = reinterpret_cast<const ChunkRecord*>(data + header.chunksOffset)[next.index];
+			for (UInt32 j = 0; j < record.childCount; ++j)
+				pending.push_back({ next.chunk->_chunks + j, record.firstChild + j, next.chunk });
+		}
+	}
+
+	void MappedImage::check_tree(const Header& header) const
+	{
+		const ChunkRecord* records = reinterpret_cast<const ChunkRecord*>(_file.data() + header.chunksOffset);
+		std::vector<bool> claimed(header.chunkCount, false);
+
+		for (UInt32 index = 0; index < header.chunkCount; ++index)
+		{
+			const ChunkRecord& record = records[index];
+			if (record.childCount == 0)
+				continue;
+
+			/* Children always follow their parent, which also rules out cycles */
+			if (record.firstChild <= index || record.childCount > header.chunkCount || record.firstChild > header.chunkCount - record.childCount)
+				reject("bad children of chunk " + std::to_string(index));
+
+			for (UInt32 child = record.firstChild; child < record.firstChild + record.childCount; ++child)
+			{
+				if (claimed[child])
+					reject("chunk " + std::to_string(child) + " has several parents");
+				claimed[child] = true;
+			}
+		}
+
+		for (UInt32 index = 1; index < header.chunkCount; ++index)
+			if (!claimed[index])
+				reject("chunk " + std::to_string(index) + " has no parent");
+	}
+
+	void MappedImage::build(Chunk& chunk, UInt32 index, const Chunk* parent, mem::Heap& heap, bool verify)
+	{
+		const Byte* data = _file.data();
+		const Header& header = *reinterpret_cast<const Header*>(data);
+		const ChunkRecord& record = reinterpret_cast<const ChunkRecord*>(data + header.chunksOffset)[index];
+
+		if (record.firstConstant > header.constantCount || record.constantCount > header.constantCount - record.firstConstant)
+			reject("bad constants of chunk " + std::to_string(index));
+		if (record.codeOffset > header.fileSize - header.codeOffset || record.codeSize > header.fileSize - header.codeOffset - record.codeOffset)
+			reject("bad code of chunk " + std::to_string(index));
+
+		/* Only formed once both ranges are known to lie in the file */
+		const ConstantRecord* constants = reinterpret_cast<const ConstantRecord*>(data + header.constantsOffset) + record.firstConstant;
+
+		std::vector<Chunk::Constant::Type> constantTypes(record.constantCount);
+		for (Offset i = 0; i < record.constantCount; ++i)
+		{
+			const ConstantRecord& constant = constants[i];
+			if (constant.type > static_cast<UInt32>(Chunk::Constant::Type::String))
+				reject("bad constant type");
+			if (constant.type == static_cast<UInt32>(Chunk::Constant::Type::String) &&
+				(constant.stringOffset > header.codeOffset - header.stringsOffset ||
+				constant.stringSize > header.codeOffset - header.stringsOffset - constant.stringOffset))
+			{
+				reject("string constant out of bounds");
+			}
+			constantTypes[i] = static_cast<Chunk::Constant::Type>(constant.type);
+		}
+
+		const instruction::InstructionValue* code = reinterpret_cast<const instruction::InstructionValue*>(data + header.codeOffset + record.codeOffset);
+
+		chunk._heap = &heap;
+		chunk._varsCount = record.varsCount;
+		chunk._tempsCount = verify
+			? verifier::verify(code, record.codeSize, record.varsCount, constantTypes.data(), record.constantCount)
+			: record.tempsCount;
+
+		/* The mapping is read-only: the code is borrowed and never written */
+		chunk._mappedCode = true;
+		chunk._instructions = const_cast<instruction::InstructionValue*>(code);
+		chunk._instructionsCount = record.codeSize;
+
+		chunk._constantsCount = record.constantCount;
+		chunk._strings = reinterpret_cast<const char*>(data + header.stringsOffset);
+		if (parent && record.constantCount > 0 && parent->_pendingConstants == constants && parent->_constantsCount == record.constantCount)
+		{
+			chunk._constants = parent->_constants;
+			chunk._sharedConstants = true;
+		}
+		else if (record.constantCount > 0)
+		{
+			chunk._constants = new data::Value[record.constantCount];
+		}
+		chunk._pendingConstants = record.constantCount == 0 ? nullptr : constants;
+
+		if (verify)
+			chunk.link_property_caches(false);
+		else
+			chunk.allocate_property_caches(record.propertyCachesCount);
+
+		chunk._chunks = record.childCount == 0 ? nullptr : new Chunk[record.childCount];
+		chunk._chunkCount = record.childCount;
+	}
+}
@@ -0,0 +1,62 @@
+#include "inline_cache.h"
+
+namespace k::runtime
+{
+	const data::Value* PropertyCache::lookup(const data::Object& object, const data::String& name)
+	{
+		if (const data::Shape::Slot* slot = object.shape().find(name))
+		{
+			add(&object.shape(), nullptr, nullptr, slot->index);
+			return &object.slot(slot->index);
+		}
+
+		const data::Object* holder = &object;
+		for (Size depth = 1; holder->parent().type() == data::DataType::Object; ++depth)
+		{
+			holder = &holder->parent().object();
+			if (const data::Shape::Slot* slot = holder->shape().find(name))
+			{
+				/* Deeper hits are not cached: validating them would walk the chain anyway */
+				if (depth == 1)
+					add(&object.shape(), holder, &holder->shape(), slot->index);
+				return &holder->slot(slot->index);
+			}
+		}
+
+		return nullptr;
+	}
+
+	bool PropertyCache::update(data::Object& object, const data::String& name, const data::Value& value)
+	{
+		data::Shape& shape = object.shape();
+		if (const data::Shape::Slot* slot = shape.find(name))
+		{
+			if (slot->isConst)
+				return false;
+
+			add(&shape, nullptr, nullptr, slot->index);
+			object.slot(slot->index) = value;
+			return true;
+		}
+
+		object.add_property(name.str(), false, value);
+		add(&shape, nullptr, &object.shape(), shape.size());
+		return true;
+	}
+
+	void PropertyCache::add(const data::Shape* shape, const data::Object* holder, const data::Shape* target, Offset index)
+	{
+		/* A dictionary shape belongs to one Object, changes in place and dies with it */
+		if (_megamorphic || shape->isDictionary() || (target && target->isDictionary()))
+			return;
+
+		if (_count == max_entries)
+		{
+			_megamorphic = true;
+			_count = 0;
+			return;
+		}
+
+		_entries[_count++] = { shape, holder, target, index };
+	}
+}
@@ -0,0 +1,68 @@
+#include "isolate.h"
+#include "operators.h"
+
+#include <atomic>
+
+namespace k::runtime
+{
+	static std::atomic<UInt64> next_program_id{ 1 };
+
+	Program::Program(
+		std::vector<instruction::InstructionValue> code,
+		Size varsCount,
+		std::vector<Chunk::Constant> constants,
+		std::vector<Program> children
+	) :
+		_id(next_program_id.fetch_add(1, std::memory_order_relaxed)),
+		_alive(std::make_shared<const bool>(true)),
+		_code(std::move(code)),
+		_varsCount(varsCount),
+		_constants(std::move(constants)),
+		_children(std::move(children))
+	{}
+
+	Chunk Program::build(mem::Heap& heap) const
+	{
+		std::vector<Chunk> chunks;
+		chunks.reserve(_children.size());
+		for (const Program& child : _children)
+			chunks.push_back(child.build(heap));
+
+		return Chunk(heap, chunks, _constants, _code, _varsCount, 0);
+	}
+
+
+	data::Function& Isolate::function(const Program& program)
+	{
+		auto it = _programs.find(program.id());
+		if (it == _programs.end())
+		{
+			if (_programs.size() >= _pruneAt)
+			{
+				prune();
+				_pruneAt = std::max(min_prune_size, _programs.size() * 2);
+			}
+
+			Instance instance;
+			instance.chunk = std::make_unique<Chunk>(program.build(_heap));
+			instance.function = _heap.create_function(*instance.chunk);
+			instance.program = program.lifetime();
+			it = _programs.emplace(program.id(), std::move(instance)).first;
+		}
+		return it->second.function.function();
+	}
+
+	void Isolate::prune()
+	{
+		std::erase_if(_programs, [](const auto& entry) { return entry.second.program.expired(); });
+	}
+
+	void Isolate::raise()
+	{
+		data::Value error = to_string(_heap, _state.getError());
+		_state.clearError();
+
+		std::string message = error.type() == data::DataType::String ? error.string().str() : "script error";
+		throw error::RuntimeError(message.c_str());
+	}
+}
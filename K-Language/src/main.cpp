@@ -3,9 +3,235 @@
 #include "opcodes.h"
 #include "chunk.h"
 #include "runtime.h"
+#include "scheduler.h"
+#include "simd.h"
+
+#include <chrono>
+
+/*
+ * Throughput of independent script invocations on 1 to N scheduler threads:
+ * each one fills an array of 4096 integers and sums it.
+ */
+static void scheduler_scaling(k::Size requests)
+{
+	using k::Opcode;
+	auto program = std::make_shared<const k::runtime::Program>(std::vector<k::instruction::InstructionValue>{
+		static_cast<k::UInt8>(Opcode::LOAD_0),
+		static_cast<k::UInt8>(Opcode::NEW_ARRAY_L),
+		static_cast<k::UInt8>(Opcode::LOAD_1),
+		static_cast<k::UInt8>(Opcode::ARRAY_OP), static_cast<k::UInt8>(k::opcode::ArrayOp::Fill),
+		static_cast<k::UInt8>(Opcode::ARRAY_REDUCE), static_cast<k::UInt8>(k::opcode::ArrayReduce::Sum),
+		static_cast<k::UInt8>(Opcode::RETURN)
+	}, 2);
+
+	double single = 0;
+	for (k::Size threads = 1; threads <= std::max(1u, std::thread::hardware_concurrency()); ++threads)
+	{
+		k::runtime::Scheduler scheduler(threads);
+		std::vector<std::future<k::data::Integer>> results;
+		results.reserve(requests);
+
+		auto start = std::chrono::steady_clock::now();
+		for (k::Size i = 0; i < requests; ++i)
+			results.push_back(scheduler.invoke<k::data::Integer>(program, 4096, static_cast<k::data::Integer>(i)));
+		for (auto& result : results)
+			result.get();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		double rate = requests / seconds;
+		if (threads == 1)
+			single = rate;
+		std::cout << threads << " threads: " << static_cast<k::UInt64>(rate) << " calls/s, x" << rate / single << std::endl;
+	}
+}
+
+/*
+ * Interpreter dispatch cost: a straight run of cheap opcodes (LOAD_0, ADD, DUP, STORE_1, LOAD_1, SWAP, POP) per
+ * call, a sequence the peephole optimizer leaves alone. The cost is divided by the instructions of the built Chunk.
+ * Build once with K_THREADED_DISPATCH=1 and once with 0 to compare direct threading with the switch.
+ */
+static void dispatch_benchmark(k::Size calls)
+{
+	using k::Opcode;
+	constexpr k::Size blocks = 256;
+
+	std::vector<k::instruction::InstructionValue> code = { static_cast<k::UInt8>(Opcode::LOADC_I), 0 };
+	for (k::Size i = 0; i < blocks; ++i)
+	{
+		code.push_back(static_cast<k::UInt8>(Opcode::LOAD_0));
+		code.push_back(static_cast<k::UInt8>(Opcode::ADD));
+		code.push_back(static_cast<k::UInt8>(Opcode::DUP));
+		code.push_back(static_cast<k::UInt8>(Opcode::STORE_1));
+		code.push_back(static_cast<k::UInt8>(Opcode::LOAD_1));
+		code.push_back(static_cast<k::UInt8>(Opcode::SWAP));
+		code.push_back(static_cast<k::UInt8>(Opcode::POP));
+	}
+	code.push_back(static_cast<k::UInt8>(Opcode::RETURN));
+	k::runtime::Program program(std::move(code), 2);
+
+	k::runtime::Isolate isolate;
+	k::data::Integer check = 0;
+	isolate.invoke<k::data::Integer>(program, 1);
+
+	/* The code runs straight through, every instruction left by the optimizer is dispatched once per call */
+	const k::Chunk& chunk = isolate.function(program).callable().chunk();
+	k::Size executed = 0;
+	for (k::Offset offset = 0; offset < chunk.instructionsCount(); ++executed)
+		offset += k::opcode::size(static_cast<Opcode>(chunk.instruction(offset)));
+
+	auto start = std::chrono::steady_clock::now();
+	for (k::Size i = 0; i < calls; ++i)
+		check += isolate.invoke<k::data::Integer>(program, static_cast<k::data::Integer>(i & 0xff));
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double opcodes = static_cast<double>(calls) * executed;
+	std::cout << (K_THREADED_DISPATCH ? "threaded" : "switch") << " dispatch: "
+		<< seconds * 1e9 / opcodes << " ns/opcode (check " << check << ")" << std::endl;
+}
+
+/*
+ * Allocation rate of short-lived blocks: a window of 256 live blocks where every step frees the oldest and
+ * allocates a new one. Slab slots against utils::malloc for the sizes of an Array and a String, then whole Heap
+ * blocks created and released through Values.
+ */
+static void allocation_benchmark(k::Size steps)
+{
+	constexpr k::Size window = 256;
+	const k::Size sizes[] = { sizeof(k::data::Array), sizeof(k::data::String) };
+
+	auto measure = [steps](auto&& step) {
+		auto start = std::chrono::steady_clock::now();
+		for (k::Size i = 0; i < steps; ++i)
+			step(i);
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	{
+		k::mem::SlabAllocator slabs;
+		void* live[window] = {};
+		double ms = measure([&](k::Size i) {
+			void*& slot = live[i % window];
+			if (slot)
+				slabs.deallocate(slot);
+			slot = slabs.allocate(k::mem::SlabAllocator::size_class(sizes[i & 1]));
+		});
+		for (void* slot : live)
+			if (slot)
+				slabs.deallocate(slot);
+		std::cout << "slab: " << ms << " ms" << std::endl;
+	}
+
+	{
+		void* live[window] = {};
+		double ms = measure([&](k::Size i) {
+			void*& slot = live[i % window];
+			k::utils::free(slot);
+			slot = k::utils::malloc<void>(sizes[i & 1]);
+		});
+		for (void* slot : live)
+			k::utils::free(slot);
+		std::cout << "malloc: " << ms << " ms" << std::endl;
+	}
+
+	{
+		k::mem::Heap heap;
+		std::vector<k::data::Value> live(window);
+		double ms = measure([&](k::Size i) {
+			live[i % window] = (i & 1) ? heap.create_string("slab") : heap.create_array();
+		});
+		live.clear();
+		std::cout << "heap blocks: " << ms << " ms" << std::endl;
+	}
+}
+
+/*
+ * Bulk Array operations on length packed elements, at every simd level the CPU supports, against the
+ * element by element loop a script would run through operator[].
+ */
+static void simd_benchmark(k::Size length)
+{
+	constexpr int rounds = 20;
+	k::mem::Heap heap;
+	k::data::Value reals = heap.create_array(), integers = heap.create_array(), result = heap.create_array();
+	for (k::Size i = 0; i < length; ++i)
+	{
+		reals.array().push_back(static_cast<k::data::Real>(i % 1000) * 0.5);
+		integers.array().push_back(static_cast<k::data::Integer>(i % 1000));
+	}
+
+	double sink = 0;
+	auto measure = [](auto&& operation) {
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < rounds; ++i)
+			operation();
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / rounds;
+	};
+	auto report = [](const char* name, const char* level, double us) {
+		std::cout << name << " " << level << ": " << us << " us" << std::endl;
+	};
+
+	k::data::Array& source = reals.array();
+	report("sum reals", "loop", measure([&] {
+		k::data::Real sum = 0;
+		for (k::Offset i = 0; i < source.size(); ++i)
+			sum += source[i].real();
+		sink += sum;
+	}));
+	report("add reals", "loop", measure([&] {
+		k::data::Array& out = result.array();
+		out.clear();
+		for (k::Offset i = 0; i < source.size(); ++i)
+			out.push_back(source[i].real() + source[i].real());
+	}));
+	report("indexOf miss", "loop", measure([&] {
+		for (k::Offset i = 0; i < source.size(); ++i)
+			if (source[i].real() == -1)
+				break;
+	}));
+
+	const k::simd::Level detected = k::simd::detected();
+	for (int level = 0; level <= static_cast<int>(detected); ++level)
+	{
+		k::simd::select(static_cast<k::simd::Level>(level));
+		const char* name = k::simd::name(static_cast<k::simd::Level>(level));
+		k::data::Value sum;
+
+		report("sum reals", name, measure([&] { source.sum(sum); sink += sum.real(); }));
+		report("sum integers", name, measure([&] { integers.array().sum(sum); sink += static_cast<double>(sum.integer()); }));
+		report("add reals", name, measure([&] { result.array().assign_add(source, source); }));
+		report("mul integers", name, measure([&] { result.array().assign_mul(integers.array(), integers.array()); }));
+		report("indexOf miss", name, measure([&] { sink += static_cast<double>(source.indexOf(-1.0)); }));
+	}
+	k::simd::select(detected);
+	std::cout << "(check " << sink << ")" << std::endl;
+}
 
 int main(int argc, char** argv)
 {
+	if (argc > 1 && std::string(argv[1]) == "--scheduler-scaling")
+	{
+		scheduler_scaling(argc > 2 ? std::stoull(argv[2]) : 200000);
+		return 0;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--allocation")
+	{
+		allocation_benchmark(argc > 2 ? std::stoull(argv[2]) : 4000000);
+		return 0;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--simd")
+	{
+		simd_benchmark(argc > 2 ? std::stoull(argv[2]) : 1 << 20);
+		return 0;
+	}
+
+	if (argc > 1 && std::string(argv[1]) == "--dispatch")
+	{
+		dispatch_benchmark(argc > 2 ? std::stoull(argv[2]) : 20000);
+		return 0;
+	}
+
 	k::mem::Heap heap;
 
 	k::data::Value a = heap.create_array(10);
@@ -0,0 +1,130 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+namespace k::utils
+{
+	MappedFile::~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile::MappedFile(MappedFile&& right) noexcept :
+		_data(std::exchange(right._data, nullptr)),
+		_size(std::exchange(right._size, 0)),
+#if defined(_WIN32)
+		_file(std::exchange(right._file, nullptr)),
+		_mapping(std::exchange(right._mapping, nullptr))
+#else
+		_fd(std::exchange(right._fd, -1))
+#endif
+	{}
+
+	MappedFile& MappedFile::operator= (MappedFile&& right) noexcept
+	{
+		this->~MappedFile();
+		return utils::move(*this, std::move(right));
+	}
+
+#if defined(_WIN32)
+	bool MappedFile::open(const std::string& path)
+	{
+		close();
+
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping)
+		{
+			CloseHandle(file);
+			return false;
+		}
+
+		void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (!view)
+		{
+			CloseHandle(mapping);
+			CloseHandle(file);
+			return false;
+		}
+
+		_file = file;
+		_mapping = mapping;
+		_data = reinterpret_cast<const Byte*>(view);
+		_size = static_cast<Size>(size.QuadPart);
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+		if (_data)
+			UnmapViewOfFile(_data);
+		if (_mapping)
+			CloseHandle(_mapping);
+		if (_file)
+			CloseHandle(_file);
+
+		_data = nullptr;
+		_size = 0;
+		_file = _mapping = nullptr;
+	}
+#else
+	bool MappedFile::open(const std::string& path)
+	{
+		close();
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0)
+		{
+			::close(fd);
+			return false;
+		}
+
+		void* view = mmap(nullptr, static_cast<Size>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED)
+		{
+			::close(fd);
+			return false;
+		}
+
+		_fd = fd;
+		_data = reinterpret_cast<const Byte*>(view);
+		_size = static_cast<Size>(info.st_size);
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+		if (_data)
+			munmap(const_cast<Byte*>(_data), _size);
+		if (_fd >= 0)
+			::close(_fd);
+
+		_data = nullptr;
+		_size = 0;
+		_fd = -1;
+	}
+#endif
+}
@@ -0,0 +1,16 @@
+#include "native.h"
+
+namespace k::native
+{
+	bool argument_error(runtime::RuntimeState& state, data::Function& function, Size index)
+	{
+		state.setError(function.owner()->intern("bad argument #" + std::to_string(index + 1) + " to native function '" + function.name() + "'"));
+		return false;
+	}
+
+	bool self_error(runtime::RuntimeState& state, data::Function& function)
+	{
+		state.setError(function.owner()->intern("native method '" + function.name() + "' called on a wrong self"));
+		return false;
+	}
+}
@@ -0,0 +1,237 @@
+#include "operators.h"
+#include "runtime.h"
+
+#include <charconv>
+#include <cmath>
+
+namespace k::runtime
+{
+	namespace
+	{
+		inline bool is_numeric(const data::Value& value)
+		{
+			switch (value.type())
+			{
+				case data::DataType::Integer:
+				case data::DataType::Real:
+				case data::DataType::Boolean:
+					return true;
+
+				default:
+					return false;
+			}
+		}
+
+		inline data::Integer as_integer(const data::Value& value)
+		{
+			return value.type() == data::DataType::Boolean ? static_cast<data::Integer>(value.boolean()) : value.integer();
+		}
+
+		inline data::Real as_real(const data::Value& value)
+		{
+			switch (value.type())
+			{
+				case data::DataType::Integer: return static_cast<data::Real>(value.integer());
+				case data::DataType::Boolean: return value.boolean() ? 1 : 0;
+				default: return value.real();
+			}
+		}
+
+		/* Exact ordering of an Integer against a non-NaN Real, converting either side could round */
+		int three_way(data::Integer integer, data::Real real)
+		{
+			data::Real converted = static_cast<data::Real>(integer);
+			if (converted < real)
+				return -1;
+			if (converted > real)
+				return 1;
+
+			/* real is integral here, and only 2^63 is out of Integer range */
+			if (real >= 9223372036854775808.0)
+				return -1;
+			data::Integer truncated = static_cast<data::Integer>(real);
+			return integer < truncated ? -1 : integer > truncated ? 1 : 0;
+		}
+
+		bool fail(RuntimeState& state, mem::Heap& heap, Opcode opcode, const char* message)
+		{
+			state.setError(heap.intern(std::string(opcode::name(opcode)) + ": " + message));
+			return false;
+		}
+	}
+
+	bool arithmetic(RuntimeState& state, mem::Heap& heap, Opcode opcode, const data::Value& left, const data::Value& right, data::Value& result)
+	{
+		if (opcode == Opcode::ADD && (left.type() == data::DataType::String || right.type() == data::DataType::String))
+		{
+			if ((!data::isScalarDataType(left.type()) && left.type() != data::DataType::String) ||
+				(!data::isScalarDataType(right.type()) && right.type() != data::DataType::String))
+			{
+				return fail(state, heap, opcode, "cannot concatenate a non-scalar value");
+			}
+
+			result = heap.concat(to_string(heap, left), to_string(heap, right));
+			return true;
+		}
+
+		if (!is_numeric(left) || !is_numeric(right))
+			return fail(state, heap, opcode, "operands must be numbers");
+
+		if (left.type() != data::DataType::Real && right.type() != data::DataType::Real)
+		{
+			data::Integer a = as_integer(left), b = as_integer(right), r;
+			bool overflow = false;
+			switch (opcode)
+			{
+				case Opcode::ADD: overflow = utils::add_overflow(a, b, &r); break;
+				case Opcode::SUB: overflow = utils::sub_overflow(a, b, &r); break;
+				case Opcode::MUL: overflow = utils::mul_overflow(a, b, &r); break;
+
+				case Opcode::DIV:
+				case Opcode::MOD:
+					if (b == 0)
+						return fail(state, heap, opcode, "integer division by zero");
+					if (a == std::numeric_limits<data::Integer>::min() && b == -1)
+					{
+						overflow = opcode == Opcode::DIV;
+						r = 0;
+					}
+					else
+						r = opcode == Opcode::DIV ? a / b : a % b;
+					break;
+
+				default:
+					K_UNREACHABLE();
+			}
+
+			if (!overflow)
+			{
+				result = r;
+				return true;
+			}
+		}
+
+		data::Real a = as_real(left), b = as_real(right);
+		switch (opcode)
+		{
+			case Opcode::ADD: result = a + b; break;
+			case Opcode::SUB: result = a - b; break;
+			case Opcode::MUL: result = a * b; break;
+			case Opcode::DIV: result = a / b; break;
+			case Opcode::MOD: result = std::fmod(a, b); break;
+			default: K_UNREACHABLE();
+		}
+		return true;
+	}
+
+	bool negate(RuntimeState& state, mem::Heap& heap, const data::Value& operand, data::Value& result)
+	{
+		switch (operand.type())
+		{
+			case data::DataType::Integer:
+			case data::DataType::Boolean:
+				if (data::Integer value = as_integer(operand); value != std::numeric_limits<data::Integer>::min())
+					result = -value;
+				else
+					result = -static_cast<data::Real>(value);
+				return true;
+
+			case data::DataType::Real:
+				result = -operand.real();
+				return true;
+
+			default:
+				return fail(state, heap, Opcode::NEG, "operand must be a number");
+		}
+	}
+
+	bool equals(const data::Value& left, const data::Value& right)
+	{
+		data::DataType type = left.type();
+		if (type != right.type())
+		{
+			if (type == data::DataType::Integer && right.type() == data::DataType::Real)
+				return right.real() == right.real() && three_way(left.integer(), right.real()) == 0;
+			if (type == data::DataType::Real && right.type() == data::DataType::Integer)
+				return left.real() == left.real() && three_way(right.integer(), left.real()) == 0;
+			return false;
+		}
+
+		switch (type)
+		{
+			case data::DataType::Undefined: return true;
+			case data::DataType::Integer: return left.integer() == right.integer();
+			case data::DataType::Real: return left.real() == right.real();
+			case data::DataType::Boolean: return left.boolean() == right.boolean();
+			case data::DataType::String: return left.string() == right.string();
+			case data::DataType::Array: return &left.array() == &right.array();
+			case data::DataType::Object: return &left.object() == &right.object();
+			case data::DataType::Function: return &left.function() == &right.function();
+			case data::DataType::Userdata: return &left.userdata() == &right.userdata();
+			default: return false;
+		}
+	}
+
+	bool compare(RuntimeState& state, mem::Heap& heap, Opcode opcode, const data::Value& left, const data::Value& right, data::Value& result)
+	{
+		int order;
+		if (left.type() == data::DataType::String && right.type() == data::DataType::String)
+		{
+			int cmp = left.string().view().compare(right.string().view());
+			order = cmp < 0 ? -1 : cmp > 0 ? 1 : 0;
+		}
+		else if (is_numeric(left) && is_numeric(right))
+		{
+			bool leftReal = left.type() == data::DataType::Real, rightReal = right.type() == data::DataType::Real;
+			if ((leftReal && left.real() != left.real()) || (rightReal && right.real() != right.real()))
+			{
+				/* Every ordering against NaN is false */
+				result = false;
+				return true;
+			}
+
+			if (leftReal && rightReal)
+				order = left.real() < right.real() ? -1 : left.real() > right.real() ? 1 : 0;
+			else if (leftReal)
+				order = -three_way(as_integer(right), left.real());
+			else if (rightReal)
+				order = three_way(as_integer(left), right.real());
+			else
+				order = as_integer(left) < as_integer(right) ? -1 : as_integer(left) > as_integer(right) ? 1 : 0;
+		}
+		else
+			return fail(state, heap, opcode, "operands must be two numbers or two strings");
+
+		switch (opcode)
+		{
+			case Opcode::LT: result = order < 0; break;
+			case Opcode::LE: result = order <= 0; break;
+			case Opcode::GT: result = order > 0; break;
+			case Opcode::GE: result = order >= 0; break;
+			default: K_UNREACHABLE();
+		}
+		return true;
+	}
+
+	data::Value to_string(mem::Heap& heap, const data::Value& value)
+	{
+		char buffer[32];
+		switch (value.type())
+		{
+			case data::DataType::Undefined:
+				return heap.intern("undefined");
+
+			case data::DataType::Integer:
+				return heap.create_string(std::string_view(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value.integer()).ptr - buffer));
+
+			case data::DataType::Real:
+				return heap.create_string(std::string_view(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value.real()).ptr - buffer));
+
+			case data::DataType::Boolean:
+				return heap.intern(value.boolean() ? "true" : "false");
+
+			default:
+				return value;
+		}
+	}
+}
@@ -0,0 +1,218 @@
+#include "optimizer.h"
+
+namespace k::optimizer
+{
+	namespace
+	{
+		struct Instruction
+		{
+			Opcode opcode;
+			instruction::InstructionValue args[4];
+		};
+
+		/* Variable index read by a LOAD_n/LOAD instruction, -1 if it is not one */
+		int loaded_var(const Instruction& inst)
+		{
+			switch (inst.opcode)
+			{
+				case Opcode::LOAD_0: return 0;
+				case Opcode::LOAD_1: return 1;
+				case Opcode::LOAD_2: return 2;
+				case Opcode::LOAD_3: return 3;
+				case Opcode::LOAD: return inst.args[0];
+				default: return -1;
+			}
+		}
+
+		/* Variable index written by a STORE_n/STORE instruction, -1 if it is not one */
+		int stored_var(const Instruction& inst)
+		{
+			switch (inst.opcode)
+			{
+				case Opcode::STORE_0: return 0;
+				case Opcode::STORE_1: return 1;
+				case Opcode::STORE_2: return 2;
+				case Opcode::STORE_3: return 3;
+				case Opcode::STORE: return inst.args[0];
+				default: return -1;
+			}
+		}
+
+		/* Pushes exactly one value and has no other effect */
+		bool is_pure_push(Opcode opcode)
+		{
+			switch (opcode)
+			{
+				case Opcode::LOADC_U:
+				case Opcode::LOADC_B:
+				case Opcode::LOADC_I:
+				case Opcode::LOADC_R:
+				case Opcode::LOADC:
+				case Opcode::LOADCW:
+				case Opcode::LOADCL:
+				case Opcode::LOAD_S:
+				case Opcode::LOAD_0:
+				case Opcode::LOAD_1:
+				case Opcode::LOAD_2:
+				case Opcode::LOAD_3:
+				case Opcode::LOAD:
+					return true;
+
+				default:
+					return false;
+			}
+		}
+
+		/* Folds inst into the tail of output, returns false if it must be appended as is */
+		bool fold(std::vector<Instruction>& output, const Instruction& inst)
+		{
+			if (inst.opcode == Opcode::NOP)
+				return true;
+
+			if (output.empty())
+				return false;
+
+			Instruction& prev = output.back();
+			switch (inst.opcode)
+			{
+				case Opcode::POP:
+					if (prev.opcode == Opcode::DUP || is_pure_push(prev.opcode))
+					{
+						output.pop_back();
+						return true;
+					}
+					return false;
+
+				case Opcode::SWAP:
+					if (prev.opcode == Opcode::SWAP)
+					{
+						output.pop_back();
+						return true;
+					}
+					return false;
+
+				default:
+					break;
+			}
+
+			int dst = stored_var(inst);
+			if (dst < 0)
+				return false;
+
+			if (int src = loaded_var(prev); src >= 0)
+			{
+				if (src == dst)
+					output.pop_back();
+				else
+					prev = { Opcode::LOAD_STORE, { static_cast<UInt8>(src), static_cast<UInt8>(dst) } };
+				return true;
+			}
+
+			if (prev.opcode == Opcode::LOADC_I)
+			{
+				prev = { Opcode::LOADC_I_STORE, { prev.args[0], static_cast<UInt8>(dst) } };
+				return true;
+			}
+
+			return false;
+		}
+	}
+
+	std::vector<instruction::InstructionValue> optimize(const instruction::InstructionValue* code, Size size)
+	{
+		std::vector<Instruction> output;
+		Offset offset = 0;
+
+		while (offset < size)
+		{
+			Opcode opcode = static_cast<Opcode>(code[offset]);
+			if (static_cast<Size>(opcode) >= opcode::count || offset + opcode::size(opcode) > size)
+				break;
+
+			Instruction inst = { opcode, {} };
+			std::copy(code + offset + 1, code + offset + opcode::size(opcode), inst.args);
+			offset += opcode::size(opcode);
+
+			if (!fold(output, inst))
+				output.push_back(inst);
+		}
+
+		std::vector<instruction::InstructionValue> result;
+		result.reserve(size);
+		for (const Instruction& inst : output)
+		{
+			result.push_back(static_cast<instruction::InstructionValue>(inst.opcode));
+			result.insert(result.end(), inst.args, inst.args + (opcode::size(inst.opcode) - 1));
+		}
+
+		/* Undecodable bytes are kept verbatim, execute never reaches them in valid code */
+		result.insert(result.end(), code + offset, code + size);
+		return result;
+	}
+
+	std::vector<instruction::InstructionValue> remap_constants(const instruction::InstructionValue* code, Size size, const std::vector<Offset>& indexes)
+	{
+		using namespace instruction::arg;
+
+		std::vector<instruction::InstructionValue> result;
+		result.reserve(size);
+
+		Offset offset = 0;
+		while (offset < size)
+		{
+			Opcode opcode = static_cast<Opcode>(code[offset]);
+			if (static_cast<Size>(opcode) >= opcode::count || offset + opcode::size(opcode) > size)
+				break;
+
+			const instruction::InstructionValue* args = code + offset + 1;
+			Offset next = offset + opcode::size(opcode);
+			Offset index = 0;
+
+			switch (opcode)
+			{
+				case Opcode::LOADC: index = indexes[get<ubyte>(args)]; break;
+				case Opcode::LOADCW: index = indexes[get<uword>(args)]; break;
+				case Opcode::LOADCL: index = indexes[get<ulong>(args)]; break;
+
+				case Opcode::GET_PROP:
+				case Opcode::SET_PROP:
+				case Opcode::GET_METHOD:
+					index = indexes[get<uword>(args)];
+					if (index > std::numeric_limits<uword>::max())
+						throw error::BytecodeError(std::string(opcode::name(opcode)) + " name constant " + std::to_string(index) + " does not fit its operand");
+
+					result.insert(result.end(), code + offset, code + next);
+					set<uword>(result.data() + result.size() - 4, static_cast<uword>(index));
+					offset = next;
+					continue;
+
+				default:
+					result.insert(result.end(), code + offset, code + next);
+					offset = next;
+					continue;
+			}
+
+			if (index <= std::numeric_limits<ubyte>::max())
+			{
+				result.push_back(static_cast<instruction::InstructionValue>(Opcode::LOADC));
+				result.push_back(static_cast<instruction::InstructionValue>(index));
+			}
+			else if (index <= std::numeric_limits<uword>::max())
+			{
+				result.push_back(static_cast<instruction::InstructionValue>(Opcode::LOADCW));
+				result.resize(result.size() + 2);
+				set<uword>(result.data() + result.size() - 2, static_cast<uword>(index));
+			}
+			else
+			{
+				result.push_back(static_cast<instruction::InstructionValue>(Opcode::LOADCL));
+				result.resize(result.size() + 4);
+				set<ulong>(result.data() + result.size() - 4, static_cast<ulong>(index));
+			}
+			offset = next;
+		}
+
+		result.insert(result.end(), code + offset, code + size);
+		return result;
+	}
+}
@@ -0,0 +1,289 @@
+#include "parcel.h"
+
+namespace k::mem
+{
+	Parcel::~Parcel()
+	{
+		clear();
+	}
+
+	Parcel::Parcel(Parcel&& right) noexcept :
+		_nodes(std::move(right._nodes)),
+		_links(std::move(right._links)),
+		_value(std::move(right._value))
+	{
+		right._nodes.clear();
+		right._links.clear();
+	}
+
+	Parcel& Parcel::operator= (Parcel&& right) noexcept
+	{
+		if (this != &right)
+		{
+			clear();
+			_nodes = std::move(right._nodes);
+			_links = std::move(right._links);
+			_value = std::move(right._value);
+			right._nodes.clear();
+			right._links.clear();
+		}
+		return *this;
+	}
+
+	void Parcel::clear()
+	{
+		for (Node& node : _nodes)
+			delete[] node.buffer;
+		_nodes.clear();
+		_links.clear();
+		_value = data::Value();
+	}
+
+	/* A boxed Integer may share its box with Values left behind, the parcel takes a box of its own */
+	static inline void unshare(data::Value& value)
+	{
+		if (value.isInteger())
+			value = data::Value(value.integer());
+	}
+
+	bool Parcel::pack(Heap& heap, data::Value& value)
+	{
+		clear();
+		if (!value.is_block() || value.isFrozen())
+		{
+			_value = std::move(value);
+			unshare(_value);
+			value = data::Value();
+			return true;
+		}
+
+		/*
+		 * Collect the graph, counting the references each block receives from inside it. Every block is also held
+		 * by keep, so that nothing is freed while the payloads move: the last references go once all are emptied.
+		 */
+		std::unordered_map<MemoryBlock*, UInt32> ids;
+		std::vector<data::Value> keep;
+		std::vector<UInt32> internal;
+
+		bool movable = true;
+		auto reach = [&](const data::Value& child) {
+			if (!child.is_block() || child.isFrozen())
+				return;
+
+			MemoryBlock* block = child.block();
+			const auto& it = ids.find(block);
+			if (it != ids.end())
+			{
+				++internal[it->second];
+				return;
+			}
+
+			if (block->_owner != &heap || child.type() == data::DataType::Function || child.type() == data::DataType::Userdata)
+				movable = false;
+			ids.emplace(block, static_cast<UInt32>(keep.size()));
+			keep.push_back(child);
+			internal.push_back(1);
+		};
+
+		reach(value);
+		internal[0] = 0;
+		for (Offset i = 0; i < keep.size() && movable; ++i)
+		{
+			switch (keep[i].type())
+			{
+				case data::DataType::String:
+					keep[i].string().data();		/* A rope becomes a leaf */
+					break;
+
+				case data::DataType::Array: {
+					const data::Array& array = keep[i].array();
+					if (array._storage == data::Array::Storage::Generic)
+						for (const data::Value& element : array._values)
+							reach(element);
+					break;
+				}
+
+				case data::DataType::Object: {
+					const data::Object& object = keep[i].object();
+					for (const data::Value& slot : object._slots)
+						reach(slot);
+					reach(object._parent);
+					reach(object._class);
+					break;
+				}
+
+				default: break;
+			}
+		}
+		if (!movable)
+			return false;
+
+		/* Besides keep, value holds the one reference to the root allowed from outside */
+		for (Offset i = 0; i < keep.size(); ++i)
+			if (keep[i].block()->_refs != internal[i] + (i == 0 ? 2 : 1))
+				return false;
+
+#if K_DEFERRED_RC
+		/* Stack slots are not counted, they are looked up instead */
+		heap.mark_roots(MemoryBlock::flag_stack);
+		for (const data::Value& block : keep)
+			movable = movable && !(block.block()->_flags & MemoryBlock::flag_stack);
+		heap.unmark_roots(MemoryBlock::flag_stack);
+		if (!movable)
+			return false;
+#endif
+
+		value = data::Value();
+
+		_nodes.resize(keep.size());
+		auto relink = [&](UInt32 node, std::ptrdiff_t index, data::Value& slot) {
+			if (slot.is_block() && !slot.isFrozen())
+			{
+				_links.push_back({ node, ids[slot.block()], index });
+				slot = data::Value();
+			}
+			else
+				unshare(slot);
+		};
+
+		for (UInt32 i = 0; i < keep.size(); ++i)
+		{
+			Node& node = _nodes[i];
+			node.type = keep[i].type();
+			switch (node.type)
+			{
+				case data::DataType::String: {
+					data::String& string = keep[i].string();
+					if (string._form == data::String::Form::Flat && !string.isInterned())
+					{
+						node.buffer = std::exchange(string._storage.flat, nullptr);
+						node.size = std::exchange(string._size, 0);
+						string._form = data::String::Form::Small;
+						string._storage.small[0] = 0;
+					}
+					else
+						node.text = string.view();
+					break;
+				}
+
+				case data::DataType::Array: {
+					data::Array& array = keep[i].array();
+					node.storage = array._storage;
+					node.holey = array._holey;
+					node.holes = array._holes;
+					switch (array._storage)
+					{
+						case data::Array::Storage::Integer: node.integers = std::move(array._integers); break;
+						case data::Array::Storage::Real: node.reals = std::move(array._reals); break;
+						case data::Array::Storage::Boolean: node.booleans = std::move(array._booleans); break;
+						default:
+							node.values = std::move(array._values);
+							for (Offset index = 0; index < node.values.size(); ++index)
+								relink(i, static_cast<std::ptrdiff_t>(index), node.values[index]);
+							break;
+					}
+					array.reset(data::Array::Storage::Integer);
+					break;
+				}
+
+				default: {
+					data::Object& object = keep[i].object();
+					object._shape->for_each([&node](const std::string& name, const data::Shape::Slot& slot) {
+						node.properties.push_back({ name, slot.isConst });
+					});
+					object.reset_shape(heap.rootShape());
+
+					node.values = std::move(object._slots);
+					object._slots.clear();
+					for (Offset index = 0; index < node.values.size(); ++index)
+						relink(i, static_cast<std::ptrdiff_t>(index), node.values[index]);
+
+					node.parent = std::move(object._parent);
+					node.objectClass = std::move(object._class);
+					relink(i, parent_link, node.parent);
+					relink(i, class_link, node.objectClass);
+					break;
+				}
+			}
+		}
+
+		keep.clear();
+		return true;
+	}
+
+	data::Value Parcel::unpack(Heap& heap)
+	{
+		if (_nodes.empty())
+		{
+			data::Value value = std::move(_value);
+			_value = data::Value();
+			return value;
+		}
+
+		std::vector<data::Value> blocks(_nodes.size());
+		for (Offset i = 0; i < _nodes.size(); ++i)
+		{
+			Node& node = _nodes[i];
+			switch (node.type)
+			{
+				case data::DataType::String:
+					if (node.buffer)
+					{
+						/* An empty String is Small, it owns no buffer to release */
+						blocks[i] = heap.create_string("");
+						data::String& string = blocks[i].string();
+						string._form = data::String::Form::Flat;
+						string._storage.flat = std::exchange(node.buffer, nullptr);
+						string._size = node.size;
+					}
+					else
+						blocks[i] = heap.create_string(node.text);
+					break;
+
+				case data::DataType::Array: {
+					blocks[i] = heap.create_array();
+					data::Array& array = blocks[i].array();
+					array.reset(node.storage);
+					switch (node.storage)
+					{
+						case data::Array::Storage::Integer: array._integers = std::move(node.integers); break;
+						case data::Array::Storage::Real: array._reals = std::move(node.reals); break;
+						case data::Array::Storage::Boolean: array._booleans = std::move(node.booleans); break;
+						default: array._values = std::move(node.values); break;
+					}
+					array._holey = node.holey;
+					array._holes = node.holes;
+					break;
+				}
+
+				default: {
+					blocks[i] = heap.create_object();
+					data::Object& object = blocks[i].object();
+					for (Offset index = 0; index < node.properties.size(); ++index)
+						object.add_property(node.properties[index].first, node.properties[index].second, std::move(node.values[index]));
+					object._parent = std::move(node.parent);
+					object._class = std::move(node.objectClass);
+					break;
+				}
+			}
+		}
+
+		for (const Link& link : _links)
+		{
+			const data::Value& child = blocks[link.child];
+			if (_nodes[link.node].type == data::DataType::Array)
+				blocks[link.node].array()._values[link.index] = child;
+			else if (link.index == parent_link)
+				blocks[link.node].object()._parent = child;
+			else if (link.index == class_link)
+				blocks[link.node].object()._class = child;
+			else
+				blocks[link.node].object()._slots[link.index] = child;
+		}
+
+		data::Value root = std::move(blocks[0]);
+		blocks.clear();
+		clear();
+		return root;
+	}
+}
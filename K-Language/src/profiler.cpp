@@ -0,0 +1,171 @@
+#include "profiler.h"
+
+#if K_PROFILER
+namespace k::runtime
+{
+	Activation::Activation(RuntimeState& state, Callable* const& callable, data::Value* const& vars, const Offset& instOffset) :
+		state(state),
+		callable(callable),
+		vars(vars),
+		instOffset(instOffset),
+		parent(state._activation)
+	{
+		state._activation = this;
+	}
+
+	Activation::~Activation()
+	{
+		state._activation = parent;
+	}
+
+
+
+	Profiler::Profiler(Mode mode, std::chrono::microseconds interval) :
+		_mode(mode),
+		_interval(interval)
+	{}
+
+	Profiler::~Profiler()
+	{
+		stop();
+	}
+
+	void Profiler::start(RuntimeState& state)
+	{
+		stop();
+		_state = &state;
+		state._profiler = this;
+
+		if (_mode == Mode::Sampling)
+		{
+			_timerStopping = false;
+			_timer = std::thread(&Profiler::tick, this);
+		}
+	}
+
+	void Profiler::stop()
+	{
+		if (_timer.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(_timerLock);
+				_timerStopping = true;
+			}
+			_timerWake.notify_one();
+			_timer.join();
+		}
+		_sampleRequested.store(false, std::memory_order_relaxed);
+
+		if (_state)
+		{
+			_state->_profiler = nullptr;
+			_state = nullptr;
+		}
+	}
+
+	void Profiler::reset()
+	{
+		std::fill(std::begin(_opcodes), std::end(_opcodes), 0);
+		_chunks.clear();
+		_lastChunk = nullptr;
+		_lastCounters = nullptr;
+		_stacks.clear();
+		_samples = 0;
+	}
+
+	const std::vector<UInt64>* Profiler::histogram(const Chunk& chunk) const
+	{
+		const auto& it = _chunks.find(&chunk);
+		return it == _chunks.end() ? nullptr : &it->second;
+	}
+
+	void Profiler::writeCollapsed(std::ostream& out) const
+	{
+		for (const auto& stack : _stacks)
+			out << stack.first << " " << stack.second << "\n";
+	}
+
+	void Profiler::reportOpcodes(std::ostream& out, Size top) const
+	{
+		std::vector<std::pair<UInt64, UInt8>> opcodes;
+		UInt64 total = 0;
+		for (UInt8 opcode = 0; opcode < opcode::count; ++opcode)
+		{
+			if (_opcodes[opcode])
+			{
+				opcodes.push_back({ _opcodes[opcode], opcode });
+				total += _opcodes[opcode];
+			}
+		}
+
+		std::sort(opcodes.begin(), opcodes.end(), [](const auto& left, const auto& right) { return left.first > right.first; });
+		if (opcodes.size() > top)
+			opcodes.resize(top);
+
+		out << (_mode == Mode::Counting ? "Executed opcodes: " : "Sampled opcodes: ") << total << std::endl;
+		for (const auto& opcode : opcodes)
+			out << opcode.first << "\t" << (opcode.first * 100.0 / total) << "%\t" << opcode::name(static_cast<Opcode>(opcode.second)) << std::endl;
+	}
+
+	void Profiler::reportChunk(std::ostream& out, const Chunk& chunk) const
+	{
+		const std::vector<UInt64>* counts = histogram(chunk);
+		if (!counts)
+			return;
+
+		/* Counts are taken on the quickened code, whose instructions keep the size of their generic form */
+		const instruction::InstructionValue* insts = chunk.code();
+		for (Offset offset = 0; offset < chunk.instructionsCount(); offset += opcode::size(static_cast<Opcode>(insts[offset])))
+		{
+			if ((*counts)[offset])
+				out << offset << "\t" << (*counts)[offset] << "\t" << opcode::name(static_cast<Opcode>(insts[offset])) << std::endl;
+		}
+	}
+
+	void Profiler::sample(RuntimeState& state, Opcode opcode)
+	{
+		_sampleRequested.store(false, std::memory_order_relaxed);
+		++_samples;
+
+		const Activation* activation = state._activation;
+		++_opcodes[static_cast<UInt8>(opcode)];
+		++counters(activation->callable->chunk())[activation->instOffset];
+
+		/*
+		 * Innermost first: the running frame of each activation, then the callers it pushed on the CallStack down
+		 * to its native CallInfo. The frame of an enclosing activation stays in its registers while a native runs.
+		 */
+		std::vector<std::string_view> frames;
+		Size index = state._calls.depth();
+		for (; activation; activation = activation->parent)
+		{
+			frames.push_back(frameName(activation->vars, *activation->callable));
+			while (index > 0 && state._calls.at(--index).callable)
+				frames.push_back(frameName(state._values.at(state._calls.at(index).bottom), *state._calls.at(index).callable));
+		}
+
+		std::string stack;
+		for (auto frame = frames.rbegin(); frame != frames.rend(); ++frame)
+		{
+			if (!stack.empty())
+				stack += ';';
+			stack += *frame;
+		}
+		++_stacks[stack];
+	}
+
+	void Profiler::tick()
+	{
+		std::unique_lock<std::mutex> lock(_timerLock);
+		while (!_timerWake.wait_for(lock, _interval, [this] { return _timerStopping; }))
+			_sampleRequested.store(true, std::memory_order_relaxed);
+	}
+
+	std::string_view Profiler::frameName(data::Value* vars, const Callable& callable)
+	{
+		/* vars[-2] holds the Function of a frame entered by CALL, or by an execute that was given it */
+		std::string_view name = vars[-2].type() == data::DataType::Function ? vars[-2].function().name() : callable.name();
+		return name.empty() ? std::string_view("<anonymous>") : name;
+	}
+}
+#endif
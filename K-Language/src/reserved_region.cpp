@@ -0,0 +1,120 @@
+#include "reserved_region.h"
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+namespace k::utils
+{
+	ReservedRegion::~ReservedRegion()
+	{
+		release();
+	}
+
+	ReservedRegion::ReservedRegion(ReservedRegion&& right) noexcept :
+		_base(std::exchange(right._base, nullptr)),
+		_reserved(std::exchange(right._reserved, 0)),
+		_committed(std::exchange(right._committed, 0))
+	{}
+
+	ReservedRegion& ReservedRegion::operator= (ReservedRegion&& right) noexcept
+	{
+		this->~ReservedRegion();
+		return utils::move(*this, std::move(right));
+	}
+
+#if defined(_WIN32)
+	Size ReservedRegion::page_size()
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return static_cast<Size>(info.dwPageSize);
+	}
+
+	void ReservedRegion::reserve(Size size)
+	{
+		release();
+
+		Size page = page_size();
+		size = (size + page - 1) / page * page;
+
+		void* base = VirtualAlloc(nullptr, size + page, MEM_RESERVE, PAGE_NOACCESS);
+		if (!base)
+			throw std::bad_alloc();
+
+		_base = reinterpret_cast<Byte*>(base);
+		_reserved = size;
+		_committed = 0;
+	}
+
+	void ReservedRegion::release()
+	{
+		if (_base)
+			VirtualFree(_base, 0, MEM_RELEASE);
+
+		_base = nullptr;
+		_reserved = _committed = 0;
+	}
+
+	bool ReservedRegion::commit_pages(Size size)
+	{
+		if (size > _reserved)
+			return false;
+
+		Size target = std::min(_reserved, (size + commit_granularity - 1) / commit_granularity * commit_granularity);
+		if (!VirtualAlloc(_base + _committed, target - _committed, MEM_COMMIT, PAGE_READWRITE))
+			return false;
+
+		_committed = target;
+		return true;
+	}
+#else
+	Size ReservedRegion::page_size()
+	{
+		return static_cast<Size>(sysconf(_SC_PAGESIZE));
+	}
+
+	void ReservedRegion::reserve(Size size)
+	{
+		release();
+
+		Size page = page_size();
+		size = (size + page - 1) / page * page;
+
+		void* base = mmap(nullptr, size + page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (base == MAP_FAILED)
+			throw std::bad_alloc();
+
+		_base = reinterpret_cast<Byte*>(base);
+		_reserved = size;
+		_committed = 0;
+	}
+
+	void ReservedRegion::release()
+	{
+		if (_base)
+			munmap(_base, _reserved + page_size());
+
+		_base = nullptr;
+		_reserved = _committed = 0;
+	}
+
+	bool ReservedRegion::commit_pages(Size size)
+	{
+		if (size > _reserved)
+			return false;
+
+		Size target = std::min(_reserved, (size + commit_granularity - 1) / commit_granularity * commit_granularity);
+		if (mprotect(_base + _committed, target - _committed, PROT_READ | PROT_WRITE) != 0)
+			return false;
+
+		_committed = target;
+		return true;
+	}
+#endif
+}
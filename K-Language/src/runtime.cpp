@@ -1,4 +1,10 @@
 #include "runtime.h"
+#include "operators.h"
+#include "fiber.h"
+#include "channel.h"
+#include "profiler.h"
+
+#include <cmath>
 
 using k::instruction::InstructionValue;
 
@@ -12,17 +18,203 @@ using k::instruction::InstructionValue;
 #define get_uquad(_ArgIdx) get_arg(uquad, _ArgIdx)
 #define get_squad(_ArgIdx) get_arg(squad, _ArgIdx)
 
+#define current_opcode() (reinterpret_cast<const Opcode*>(insts)[instOffset])
+
+#if K_THREADED_DISPATCH
+#define opcode_label(_Opcode) &&op_##_Opcode
+#define opcode_case(_Opcode) op_##_Opcode: {
+#define opcode_dispatch() { count_opcode_pair(); profile_opcode(); goto *dispatch_table[static_cast<UInt8>(current_opcode())]; }
+#define opcode_redispatch() goto *dispatch_table[static_cast<UInt8>(current_opcode())]
+#define opcode_dispatch_begin() opcode_dispatch(); {
+#define opcode_dispatch_end() }
+#define opcode_end(_Bytes) instOffset += _Bytes; } opcode_dispatch()
+#else
 #define opcode_case(_Opcode) case Opcode::_Opcode: {
+#define opcode_dispatch() goto main_loop
+#define opcode_redispatch() goto redispatch
+#define opcode_dispatch_begin() count_opcode_pair(); profile_opcode(); redispatch: switch (current_opcode()) {
+#define opcode_dispatch_end() default: K_UNREACHABLE(); }
+#define opcode_end(_Bytes) opcode_end_and_jump(_Bytes, main_loop)
+#endif
+
+#if K_OPCODE_PAIR_STATS
+#define count_opcode_pair() (++opcode_pairs[previousOpcode][static_cast<UInt8>(current_opcode())], previousOpcode = static_cast<UInt8>(current_opcode()))
+#else
+#define count_opcode_pair() ((void) 0)
+#endif
+
+#if K_PROFILER
+#define profile_opcode() if(profiler) { profiler->dispatch(state, callable, instOffset, current_opcode()); }
+#else
+#define profile_opcode() ((void) 0)
+#endif
+
 #define opcode_end_and_jump(_Bytes, _Tag) instOffset += _Bytes; } goto _Tag
 #define opcode_abort_and_jump(_Bytes, _Tag) instOffset += _Bytes; goto _Tag
-#define opcode_end(_Bytes) opcode_end_and_jump(_Bytes, main_loop)
 #define opcode_abort_error(_Bytes) opcode_abort_and_jump(_Bytes, error_zone)
 
-#define check_errors(_Bytes) if(state._error.state) opcode_abort_error(_Bytes)
+#define check_errors(_Bytes) if(state._error.state) { opcode_abort_error(_Bytes); }
+#define check_object(_Value, _Bytes) if((_Value).type() != data::DataType::Object) { \
+	state.setError(callable->heap().intern("property access on a non-object value")); \
+	opcode_abort_error(_Bytes); }
+
+#define check_function(_Value, _Bytes) if((_Value).type() != data::DataType::Function) { \
+	state.setError(callable->heap().intern("call of a non-function value")); \
+	opcode_abort_error(_Bytes); }
+
+#define check_array(_Value, _Bytes) if((_Value).type() != data::DataType::Array) { \
+	state.setError(callable->heap().intern("array operation on a non-array value")); \
+	opcode_abort_error(_Bytes); }
+
+/* Generic path of NEG, the result replaces the operand */
+#define negate_slow_path() { data::Value result; \
+	if (!runtime::negate(state, callable->heap(), operand, result)) { opcode_abort_error(1); } \
+	slot_move(operand, std::move(result)); }
+
+/* Generic path of a [2] -> [1] operator: the result replaces the left operand */
+#define binary_slow_path(_Function, _Opcode) { data::Value result; \
+	if (!runtime::_Function(state, callable->heap(), Opcode::_Opcode, left, right, result)) { opcode_abort_error(1); } \
+	slot_move(left, std::move(result)); }
+
+/* Rewrites the running instruction for the operand types just seen, the first one moves execute to the shadow code */
+#define quicken(_Quickened) { callable->chunk().quicken(instOffset, Opcode::_Quickened); insts = callable->code(); }
+
+/*
+ * Guard of a quickened form: on failure the generic opcode is restored and run on the same operands. The instruction
+ * was already counted when the quickened form was dispatched, the re-dispatch skips the pair stats and the Profiler.
+ */
+#define dequicken_guard(_Condition) if (!(_Condition)) { \
+	callable->chunk().dequicken(instOffset); \
+	opcode_redispatch(); }
+
+#define integer_arithmetic_case(_Opcode, _Overflow, _RealOp) opcode_case(_Opcode) \
+	data::Value& left = temps[tempsTop - 2]; \
+	const data::Value& right = temps[tempsTop - 1]; \
+	data::Integer result; \
+	if (left.isInteger() && right.isInteger() && !utils::_Overflow(left.integer(), right.integer(), &result)) { \
+		slot_move(left, data::Value(result)); \
+		quicken(_Opcode##_II); } \
+	else if (left.isReal() && right.isReal()) { \
+		slot_move(left, data::Value(left.real() _RealOp right.real())); \
+		quicken(_Opcode##_RR); } \
+	else \
+		binary_slow_path(arithmetic, _Opcode); \
+	--tempsTop; \
+	opcode_end(1)
+
+#define comparison_case(_Opcode, _Op) opcode_case(_Opcode) \
+	data::Value& left = temps[tempsTop - 2]; \
+	const data::Value& right = temps[tempsTop - 1]; \
+	if (left.isInteger() && right.isInteger()) { \
+		slot_move(left, data::Value(left.integer() _Op right.integer())); \
+		quicken(_Opcode##_II); } \
+	else if (left.isReal() && right.isReal()) { \
+		slot_move(left, data::Value(left.real() _Op right.real())); \
+		quicken(_Opcode##_RR); } \
+	else \
+		binary_slow_path(compare, _Opcode); \
+	--tempsTop; \
+	opcode_end(1)
+
+/* Integer overflow does not fail the guard, the operand types still hold */
+#define quickened_integer_case(_Opcode, _Overflow) opcode_case(_Opcode##_II) \
+	data::Value& left = temps[tempsTop - 2]; \
+	const data::Value& right = temps[tempsTop - 1]; \
+	dequicken_guard(left.isInteger() && right.isInteger()); \
+	data::Integer result; \
+	if (!utils::_Overflow(left.integer(), right.integer(), &result)) \
+		slot_move(left, data::Value(result)); \
+	else \
+		binary_slow_path(arithmetic, _Opcode); \
+	--tempsTop; \
+	opcode_end(1)
+
+/* Zero and -1 divisors are left to the generic path, which fails or promotes like DIV and MOD do */
+#define quickened_division_case(_Quickened, _Opcode, _Op) opcode_case(_Quickened) \
+	data::Value& left = temps[tempsTop - 2]; \
+	const data::Value& right = temps[tempsTop - 1]; \
+	dequicken_guard(left.isInteger() && right.isInteger()); \
+	if (right.integer() != 0 && right.integer() != -1) \
+		slot_move(left, data::Value(left.integer() _Op right.integer())); \
+	else \
+		binary_slow_path(arithmetic, _Opcode); \
+	--tempsTop; \
+	opcode_end(1)
+
+#define quickened_case(_Quickened, _Check, _Get, _Op) opcode_case(_Quickened) \
+	data::Value& left = temps[tempsTop - 2]; \
+	const data::Value& right = temps[tempsTop - 1]; \
+	dequicken_guard(left._Check() && right._Check()); \
+	slot_move(left, data::Value(left._Get() _Op right._Get())); \
+	--tempsTop; \
+	opcode_end(1)
+
+#if K_DEFERRED_RC
+#define slot_copy(_Slot, _Value) data::Value::copy_uncounted((_Slot), (_Value))
+#define slot_move(_Slot, _Value) data::Value::move_uncounted((_Slot), (_Value))
+#else
+#define slot_copy(_Slot, _Value) ((_Slot) = (_Value))
+#define slot_move(_Slot, _Value) ((_Slot) = (_Value))
+#endif
 
 namespace k::runtime
 {
-	data::Value execute(RuntimeState& state, Callable& input_callable, const data::Value* input_self, const data::Value* args, Size argsCount)
+#if K_OPCODE_PAIR_STATS
+	/* Row opcode::count holds the first opcode of each execute call */
+	static UInt64 opcode_pairs[opcode::count + 1][opcode::count] = {};
+
+	void reset_opcode_pairs()
+	{
+		std::fill(&opcode_pairs[0][0], &opcode_pairs[0][0] + std::size(opcode_pairs) * opcode::count, 0);
+	}
+
+	void report_opcode_pairs(std::ostream& out, Size top)
+	{
+		struct Pair
+		{
+			UInt64 count;
+			UInt8 first;
+			UInt8 second;
+		};
+
+		std::vector<Pair> pairs;
+		UInt64 total = 0;
+		for (UInt8 first = 0; first < opcode::count; ++first)
+		{
+			for (UInt8 second = 0; second < opcode::count; ++second)
+			{
+				if (UInt64 count = opcode_pairs[first][second])
+				{
+					pairs.push_back({ count, first, second });
+					total += count;
+				}
+			}
+		}
+
+		std::sort(pairs.begin(), pairs.end(), [](const Pair& left, const Pair& right) { return left.count > right.count; });
+		if (pairs.size() > top)
+			pairs.resize(top);
+
+		out << "Executed opcode pairs: " << total << std::endl;
+		for (const Pair& pair : pairs)
+		{
+			out << pair.count << "\t" << (pair.count * 100.0 / total) << "%\t"
+				<< opcode::name(static_cast<Opcode>(pair.first)) << " " << opcode::name(static_cast<Opcode>(pair.second)) << std::endl;
+		}
+	}
+#endif
+
+	data::Value execute(RuntimeState& state, Callable& callable, const data::Value* self, const data::Value* args, Size argsCount, const data::Value* function)
+	{
+		return RuntimeState::run(state, &callable, function, self, args, argsCount, nullptr);
+	}
+
+	data::Value resume(RuntimeState& state, const data::Value& value)
+	{
+		return RuntimeState::run(state, nullptr, nullptr, nullptr, nullptr, 0, &value);
+	}
+
+	data::Value RuntimeState::run(RuntimeState& state, Callable* input_callable, const data::Value* input_function, const data::Value* input_self, const data::Value* args, Size argsCount, const data::Value* resumed)
 	{
 		const InstructionValue* insts;
 		Offset instOffset;
@@ -31,23 +223,153 @@ namespace k::runtime
 		data::Value* self;
 		data::Value* temps;
 		Offset tempsTop;
+#if K_OPCODE_PAIR_STATS
+		UInt8 previousOpcode = opcode::count;
+#endif
 
-		state._calls.pushNative();
-		callable = &input_callable;
-		state._values.push(0, argsCount, callable->stackCount(), &vars);
-		self = vars + callable->varsCount();
-		temps = self + 1;
-		tempsTop = 0;
-		instOffset = 0;
-		insts = callable->instructionData();
-		for (Offset i = 0; i < argsCount; ++i)
-			vars[i] = args[i];
-		if (input_self)
-			*self = *input_self;
+		std::ptrdiff_t frameBottom;
 
-	main_loop:
-		switch (reinterpret_cast<const Opcode*>(insts)[instOffset])
+		/* Only the outermost activation of a Fiber state can be suspended, natives cannot be unwound and rewound */
+		const bool yieldable = state._fiber && (resumed || state._calls.depth() == 0);
+
+		if (resumed)
 		{
+			/* Back into the activation parked by YIELD, the resume value is the YIELD result */
+			callable = std::exchange(state._suspended.callable, nullptr);
+			frameBottom = state._suspended.frameBottom;
+			vars = state._values.at(state._suspended.vars);
+			self = vars + callable->varsCount();
+			temps = self + 1;
+			tempsTop = state._suspended.tempsTop;
+			instOffset = state._suspended.instOffset;
+			insts = callable->code();
+			slot_copy(temps[tempsTop], *resumed);
+			++tempsTop;
+		}
+		else
+		{
+			state._calls.pushNative();
+			callable = input_callable;
+			frameBottom = state._values.current_offset();
+
+			/* Every frame has two slots under its vars, the Function being run and a self staged by CALL/TAILCALL */
+			if (!state._values.push(0, 0, callable->stackCount() + 2, &vars))
+			{
+				state._calls.pop();
+				state.setError(callable->heap().intern("value stack overflow"));
+				return data::Value();
+			}
+			vars += 2;
+			self = vars + callable->varsCount();
+			temps = self + 1;
+			tempsTop = 0;
+			instOffset = 0;
+			insts = callable->code();
+			for (Offset i = 0; i < std::min(argsCount, callable->varsCount()); ++i)
+				slot_copy(vars[i], args[i]);
+			if (input_self)
+				slot_copy(*self, *input_self);
+			if (input_function)
+				slot_copy(vars[-2], *input_function);
+		}
+
+#if K_PROFILER
+		Profiler* const profiler = state._profiler;
+		Activation activation(state, callable, vars, instOffset);
+#endif
+
+#if K_DEFERRED_RC
+		callable->heap().attach(state._values);
+#endif
+
+#if K_THREADED_DISPATCH
+		static const void* const dispatch_table[] = {
+			opcode_label(NOP),
+			opcode_label(POP),
+			opcode_label(POP2),
+			opcode_label(SWAP),
+			opcode_label(DUP),
+			opcode_label(DUP_X1),
+			opcode_label(DUP_X2),
+			opcode_label(LOADC_U),
+			opcode_label(LOADC_B),
+			opcode_label(LOADC_I),
+			opcode_label(LOADC_R),
+			opcode_label(LOADC),
+			opcode_label(LOADCW),
+			opcode_label(LOADCL),
+			opcode_label(LOAD_S),
+			opcode_label(LOAD_0),
+			opcode_label(LOAD_1),
+			opcode_label(LOAD_2),
+			opcode_label(LOAD_3),
+			opcode_label(LOAD),
+			opcode_label(NEW_ARRAY),
+			opcode_label(NEW_ARRAY_C),
+			opcode_label(NEW_ARRAY_L),
+			opcode_label(ARRAY_REDUCE),
+			opcode_label(ARRAY_OP),
+			opcode_label(ARRAY_SLICE),
+			opcode_label(ADD),
+			opcode_label(SUB),
+			opcode_label(MUL),
+			opcode_label(DIV),
+			opcode_label(MOD),
+			opcode_label(NEG),
+			opcode_label(EQ),
+			opcode_label(NE),
+			opcode_label(LT),
+			opcode_label(LE),
+			opcode_label(GT),
+			opcode_label(GE),
+			opcode_label(ADD_II),
+			opcode_label(SUB_II),
+			opcode_label(MUL_II),
+			opcode_label(DIV_II),
+			opcode_label(MOD_II),
+			opcode_label(NEG_I),
+			opcode_label(ADD_RR),
+			opcode_label(SUB_RR),
+			opcode_label(MUL_RR),
+			opcode_label(DIV_RR),
+			opcode_label(MOD_RR),
+			opcode_label(NEG_R),
+			opcode_label(EQ_II),
+			opcode_label(NE_II),
+			opcode_label(LT_II),
+			opcode_label(LE_II),
+			opcode_label(GT_II),
+			opcode_label(GE_II),
+			opcode_label(LT_RR),
+			opcode_label(LE_RR),
+			opcode_label(GT_RR),
+			opcode_label(GE_RR),
+			opcode_label(STORE_S),
+			opcode_label(STORE_0),
+			opcode_label(STORE_1),
+			opcode_label(STORE_2),
+			opcode_label(STORE_3),
+			opcode_label(STORE),
+			opcode_label(GET_PROP),
+			opcode_label(SET_PROP),
+			opcode_label(GET_METHOD),
+			opcode_label(LOAD_STORE),
+			opcode_label(LOADC_I_STORE),
+			opcode_label(CALL),
+			opcode_label(TAILCALL),
+			opcode_label(YIELD),
+			opcode_label(RESUME),
+			opcode_label(SEND),
+			opcode_label(RECEIVE),
+			opcode_label(RETURN),
+		};
+		static_assert(std::size(dispatch_table) == opcode::count, "dispatch_table must have one entry per Opcode, in enum order");
+#endif
+
+#if !K_THREADED_DISPATCH
+	main_loop:
+#endif
+		opcode_dispatch_begin()
 			opcode_case(NOP)
 			opcode_end(1);
 
@@ -67,121 +389,595 @@ namespace k::runtime
 
 
 			opcode_case(DUP)
-				temps[tempsTop] = temps[tempsTop - 1];
+				slot_copy(temps[tempsTop], temps[tempsTop - 1]);
 				++tempsTop;
 			opcode_end(1);
 
 			opcode_case(DUP_X1)
-				temps[tempsTop] = temps[tempsTop - 1];
-				temps[tempsTop - 1] = temps[tempsTop - 2];
-				temps[tempsTop - 2] = temps[tempsTop];
+				slot_copy(temps[tempsTop], temps[tempsTop - 1]);
+				slot_copy(temps[tempsTop - 1], temps[tempsTop - 2]);
+				slot_copy(temps[tempsTop - 2], temps[tempsTop]);
 				++tempsTop;
 			opcode_end(1);
 
 			opcode_case(DUP_X2)
-				temps[tempsTop] = temps[tempsTop - 1];
-				temps[tempsTop - 1] = temps[tempsTop - 2];
-				temps[tempsTop - 2] = temps[tempsTop - 3];
-				temps[tempsTop - 3] = temps[tempsTop];
+				slot_copy(temps[tempsTop], temps[tempsTop - 1]);
+				slot_copy(temps[tempsTop - 1], temps[tempsTop - 2]);
+				slot_copy(temps[tempsTop - 2], temps[tempsTop - 3]);
+				slot_copy(temps[tempsTop - 3], temps[tempsTop]);
 				++tempsTop;
 			opcode_end(1);
 
 
 			opcode_case(LOADC_U)
-				temps[tempsTop++] = nullptr;
+				slot_move(temps[tempsTop++], data::Value(nullptr));
 			opcode_end(1);
 
 			opcode_case(LOADC_B)
-				temps[tempsTop++] = get_ubyte(1) != 0;
+				slot_move(temps[tempsTop++], data::Value(get_ubyte(1) != 0));
 			opcode_end(2);
 
 			opcode_case(LOADC_I)
-				temps[tempsTop++] = get_sbyte(1);
+				slot_move(temps[tempsTop++], data::Value(get_sbyte(1)));
 			opcode_end(2);
 
 			opcode_case(LOADC_R)
-				temps[tempsTop++] = static_cast<double>(get_sbyte(1));
+				slot_move(temps[tempsTop++], data::Value(static_cast<double>(get_sbyte(1))));
 			opcode_end(2);
 
 			opcode_case(LOADC)
-				temps[tempsTop++] = callable->constant(get_ubyte(1));
+				slot_copy(temps[tempsTop++], callable->constant(get_ubyte(1)));
 			opcode_end(2);
 
 			opcode_case(LOADCW)
-				temps[tempsTop++] = callable->constant(get_uword(1));
+				slot_copy(temps[tempsTop++], callable->constant(get_uword(1)));
 			opcode_end(3);
 
 			opcode_case(LOADCL)
-				temps[tempsTop++] = callable->constant(get_ulong(1));
+				slot_copy(temps[tempsTop++], callable->constant(get_ulong(1)));
 			opcode_end(5);
 
 
 			opcode_case(LOAD_S)
-				temps[tempsTop++] = *self;
+				slot_copy(temps[tempsTop++], *self);
 			opcode_end(1);
 
 			opcode_case(LOAD_0)
-				temps[tempsTop++] = vars[0];
+				slot_copy(temps[tempsTop++], vars[0]);
 			opcode_end(1);
 
 			opcode_case(LOAD_1)
-				temps[tempsTop++] = vars[1];
+				slot_copy(temps[tempsTop++], vars[1]);
 			opcode_end(1);
 
 			opcode_case(LOAD_2)
-				temps[tempsTop++] = vars[2];
+				slot_copy(temps[tempsTop++], vars[2]);
 			opcode_end(1);
 
 			opcode_case(LOAD_3)
-				temps[tempsTop++] = vars[3];
+				slot_copy(temps[tempsTop++], vars[3]);
 			opcode_end(1);
 
 			opcode_case(LOAD)
-				temps[tempsTop++] = vars[get_ubyte(1)];
+				slot_copy(temps[tempsTop++], vars[get_ubyte(1)]);
 			opcode_end(2);
 
 
 			opcode_case(NEW_ARRAY)
-				temps[tempsTop++] = callable->heap().create_array();
+				slot_move(temps[tempsTop++], callable->heap().create_array());
 			opcode_end(1);
 
 			opcode_case(NEW_ARRAY_C)
-				temps[tempsTop++] = callable->heap().create_array(get_ubyte(1));
+				slot_move(temps[tempsTop++], callable->heap().create_array(get_ubyte(1)));
 			opcode_end(2);
 
 			opcode_case(NEW_ARRAY_L)
-				data::Integer idx = temps[tempsTop - 1].runtime_cast_integer(state);
+				data::Integer len = temps[tempsTop - 1].runtime_cast_integer(state, callable->heap());
+				check_errors(1);
+				if (len < 0 || static_cast<UInt64>(len) > data::Array::max_length)
+				{
+					state.setError(callable->heap().intern("invalid array length"));
+					opcode_abort_error(1);
+				}
+				slot_move(temps[tempsTop - 1], callable->heap().create_array(len));
+			opcode_end(1);
+
+			opcode_case(ARRAY_REDUCE)
+				data::Value& target = temps[tempsTop - 1];
+				check_array(target, 2);
+
+				data::Value result;
+				bool valid;
+				switch (static_cast<opcode::ArrayReduce>(get_ubyte(1)))
+				{
+					case opcode::ArrayReduce::Sum: valid = target.array().sum(result); break;
+					case opcode::ArrayReduce::Min: valid = target.array().min(result); break;
+					default: valid = target.array().max(result); break;
+				}
+				if (!valid)
+				{
+					state.setError(callable->heap().intern("array element is not a number"));
+					opcode_abort_error(2);
+				}
+				slot_move(target, std::move(result));
+			opcode_end(2);
+
+			opcode_case(ARRAY_OP)
+				data::Value& target = temps[tempsTop - 2];
+				const data::Value& operand = temps[tempsTop - 1];
+				check_array(target, 2);
+
+				data::Value result;
+				switch (static_cast<opcode::ArrayOp>(get_ubyte(1)))
+				{
+					case opcode::ArrayOp::Add:
+					case opcode::ArrayOp::Mul:
+						check_array(operand, 2);
+						result = callable->heap().create_array();
+						if (!(static_cast<opcode::ArrayOp>(get_ubyte(1)) == opcode::ArrayOp::Add
+							? result.array().assign_add(target.array(), operand.array())
+							: result.array().assign_mul(target.array(), operand.array())))
+						{
+							state.setError(callable->heap().intern("arrays differ in length or hold a non-number"));
+							opcode_abort_error(2);
+						}
+						break;
+
+					case opcode::ArrayOp::IndexOf:
+						result = target.array().indexOf(operand);
+						break;
+
+					case opcode::ArrayOp::Equals:
+						result = operand.type() == data::DataType::Array && target.array().equals(operand.array());
+						break;
+
+					default:
+						if (target.array().isFrozen())
+						{
+							state.setError(callable->heap().intern("cannot fill a frozen array"));
+							opcode_abort_error(2);
+						}
+						target.array().fill(operand);
+						result = target;
+						break;
+				}
+				slot_move(target, std::move(result));
+				--tempsTop;
+			opcode_end(2);
+
+			opcode_case(ARRAY_SLICE)
+				data::Value& target = temps[tempsTop - 3];
+				check_array(target, 1);
+				data::Integer first = temps[tempsTop - 2].runtime_cast_integer(state, callable->heap());
+				data::Integer last = temps[tempsTop - 1].runtime_cast_integer(state, callable->heap());
 				check_errors(1);
-				temps[tempsTop - 1] = callable->heap().create_array(temps[tempsTop - 1].runtime_cast_integer(state));
+
+				data::Value result = callable->heap().create_array();
+				result.array().assign_slice(target.array(), static_cast<Offset>(std::max<data::Integer>(first, 0)), static_cast<Offset>(std::max<data::Integer>(last, 0)));
+				slot_move(target, std::move(result));
+				tempsTop -= 2;
 			opcode_end(1);
 
 
+			integer_arithmetic_case(ADD, add_overflow, +);
+			integer_arithmetic_case(SUB, sub_overflow, -);
+			integer_arithmetic_case(MUL, mul_overflow, *);
+
+			opcode_case(DIV)
+				data::Value& left = temps[tempsTop - 2];
+				const data::Value& right = temps[tempsTop - 1];
+				if (left.isInteger() && right.isInteger() && right.integer() != 0 &&
+					(right.integer() != -1 || left.integer() != std::numeric_limits<data::Integer>::min()))
+				{
+					slot_move(left, data::Value(left.integer() / right.integer()));
+					quicken(DIV_II);
+				}
+				else if (left.isReal() && right.isReal())
+				{
+					slot_move(left, data::Value(left.real() / right.real()));
+					quicken(DIV_RR);
+				}
+				else
+					binary_slow_path(arithmetic, DIV);
+				--tempsTop;
+			opcode_end(1);
+
+			opcode_case(MOD)
+				data::Value& left = temps[tempsTop - 2];
+				const data::Value& right = temps[tempsTop - 1];
+				if (left.isInteger() && right.isInteger() && right.integer() != 0 && right.integer() != -1)
+				{
+					slot_move(left, data::Value(left.integer() % right.integer()));
+					quicken(MOD_II);
+				}
+				else if (left.isReal() && right.isReal())
+				{
+					slot_move(left, data::Value(std::fmod(left.real(), right.real())));
+					quicken(MOD_RR);
+				}
+				else
+					binary_slow_path(arithmetic, MOD);
+				--tempsTop;
+			opcode_end(1);
+
+			opcode_case(NEG)
+				data::Value& operand = temps[tempsTop - 1];
+				if (operand.isInteger() && operand.integer() != std::numeric_limits<data::Integer>::min())
+				{
+					slot_move(operand, data::Value(-operand.integer()));
+					quicken(NEG_I);
+				}
+				else if (operand.isReal())
+				{
+					slot_move(operand, data::Value(-operand.real()));
+					quicken(NEG_R);
+				}
+				else
+					negate_slow_path();
+			opcode_end(1);
+
+			opcode_case(EQ)
+				data::Value& left = temps[tempsTop - 2];
+				const data::Value& right = temps[tempsTop - 1];
+				bool result;
+				if (left.isInteger() && right.isInteger())
+				{
+					result = left.integer() == right.integer();
+					quicken(EQ_II);
+				}
+				else
+					result = runtime::equals(left, right);
+				slot_move(left, data::Value(result));
+				--tempsTop;
+			opcode_end(1);
+
+			opcode_case(NE)
+				data::Value& left = temps[tempsTop - 2];
+				const data::Value& right = temps[tempsTop - 1];
+				bool result;
+				if (left.isInteger() && right.isInteger())
+				{
+					result = left.integer() != right.integer();
+					quicken(NE_II);
+				}
+				else
+					result = !runtime::equals(left, right);
+				slot_move(left, data::Value(result));
+				--tempsTop;
+			opcode_end(1);
+
+			comparison_case(LT, <);
+			comparison_case(LE, <=);
+			comparison_case(GT, >);
+			comparison_case(GE, >=);
+
+
+			quickened_integer_case(ADD, add_overflow);
+			quickened_integer_case(SUB, sub_overflow);
+			quickened_integer_case(MUL, mul_overflow);
+			quickened_division_case(DIV_II, DIV, /);
+			quickened_division_case(MOD_II, MOD, %);
+
+			opcode_case(NEG_I)
+				data::Value& operand = temps[tempsTop - 1];
+				dequicken_guard(operand.isInteger());
+				if (operand.integer() != std::numeric_limits<data::Integer>::min())
+					slot_move(operand, data::Value(-operand.integer()));
+				else
+					negate_slow_path();
+			opcode_end(1);
+
+			quickened_case(ADD_RR, isReal, real, +);
+			quickened_case(SUB_RR, isReal, real, -);
+			quickened_case(MUL_RR, isReal, real, *);
+			quickened_case(DIV_RR, isReal, real, /);
+
+			opcode_case(MOD_RR)
+				data::Value& left = temps[tempsTop - 2];
+				const data::Value& right = temps[tempsTop - 1];
+				dequicken_guard(left.isReal() && right.isReal());
+				slot_move(left, data::Value(std::fmod(left.real(), right.real())));
+				--tempsTop;
+			opcode_end(1);
+
+			opcode_case(NEG_R)
+				data::Value& operand = temps[tempsTop - 1];
+				dequicken_guard(operand.isReal());
+				slot_move(operand, data::Value(-operand.real()));
+			opcode_end(1);
+
+			quickened_case(EQ_II, isInteger, integer, ==);
+			quickened_case(NE_II, isInteger, integer, !=);
+			quickened_case(LT_II, isInteger, integer, <);
+			quickened_case(LE_II, isInteger, integer, <=);
+			quickened_case(GT_II, isInteger, integer, >);
+			quickened_case(GE_II, isInteger, integer, >=);
+
+			quickened_case(LT_RR, isReal, real, <);
+			quickened_case(LE_RR, isReal, real, <=);
+			quickened_case(GT_RR, isReal, real, >);
+			quickened_case(GE_RR, isReal, real, >=);
+
+
 			opcode_case(STORE_S)
-				*self = temps[--tempsTop];
+				slot_copy(*self, temps[--tempsTop]);
 			opcode_end(1);
 			
 			opcode_case(STORE_0)
-				vars[0] = temps[--tempsTop];
+				slot_copy(vars[0], temps[--tempsTop]);
 			opcode_end(1);
 
 			opcode_case(STORE_1)
-				vars[1] = temps[--tempsTop];
+				slot_copy(vars[1], temps[--tempsTop]);
 			opcode_end(1);
 
 			opcode_case(STORE_2)
-				vars[2] = temps[--tempsTop];
+				slot_copy(vars[2], temps[--tempsTop]);
 			opcode_end(1);
 
 			opcode_case(STORE_3)
-				vars[3] = temps[--tempsTop];
+				slot_copy(vars[3], temps[--tempsTop]);
 			opcode_end(1);
 
 			opcode_case(STORE)
-				vars[get_ubyte(1)] = temps[--tempsTop];
+				slot_copy(vars[get_ubyte(1)], temps[--tempsTop]);
+			opcode_end(2);
+
+
+			opcode_case(GET_PROP)
+				data::Value& receiver = temps[tempsTop - 1];
+				check_object(receiver, 5);
+
+				runtime::PropertyCache& cache = callable->chunk().propertyCache(get_uword(3));
+				const data::Value* value = cache.load(receiver.object());
+				if (!value)
+					value = cache.lookup(receiver.object(), callable->constant(get_uword(1)).string());
+
+				/* Copy first: the receiver slot may hold the last reference to the object owning *value */
+				data::Value result = value ? *value : data::Value();
+				slot_move(receiver, std::move(result));
+			opcode_end(5);
+
+			opcode_case(SET_PROP)
+				data::Value& receiver = temps[tempsTop - 2];
+				check_object(receiver, 5);
+
+				/* Frozen shapes never reach a store cache, update is where a frozen receiver is caught */
+				runtime::PropertyCache& cache = callable->chunk().propertyCache(get_uword(3));
+				if (!cache.store(receiver.object(), temps[tempsTop - 1]))
+				{
+					if (receiver.object().isFrozen())
+					{
+						state.setError(callable->heap().intern("cannot assign to a frozen object"));
+						opcode_abort_error(5);
+					}
+					if (!cache.update(receiver.object(), callable->constant(get_uword(1)).string(), temps[tempsTop - 1]))
+					{
+						state.setError(callable->heap().intern("cannot assign to a const property"));
+						opcode_abort_error(5);
+					}
+				}
+				tempsTop -= 2;
+			opcode_end(5);
+
+			opcode_case(GET_METHOD)
+				data::Value& receiver = temps[tempsTop - 1];
+				check_object(receiver, 5);
+
+				runtime::PropertyCache& cache = callable->chunk().propertyCache(get_uword(3));
+				const data::Value* value = cache.load(receiver.object());
+				if (!value)
+					value = cache.lookup(receiver.object(), callable->constant(get_uword(1)).string());
+
+				/* [object] -> [method, object], the receiver becomes the self of the call */
+				slot_copy(temps[tempsTop], receiver);
+				if (value)
+					slot_copy(receiver, *value);
+				else
+					slot_move(receiver, data::Value());
+				++tempsTop;
+			opcode_end(5);
+
+
+			opcode_case(LOAD_STORE)
+				slot_copy(vars[get_ubyte(2)], vars[get_ubyte(1)]);
+			opcode_end(3);
+
+			opcode_case(LOADC_I_STORE)
+				slot_move(vars[get_ubyte(2)], data::Value(get_sbyte(1)));
+			opcode_end(3);
+
+
+			/*
+			 * Script calls stay in this activation. The callee frame starts at the first argument, so the arguments
+			 * become its first vars in place, and the caller resumes from the CallInfo pushed here.
+			 */
+			opcode_case(CALL)
+				Size argsCount = get_ubyte(1);
+				data::Value* function = temps + (tempsTop - argsCount - 2);
+				check_function(*function, 2);
+
+				if (function->function().isNative())
+				{
+					data::Value result;
+					if (!function->function().native()(state, function->function(), function[1], function + 2, argsCount, result))
+					{
+						opcode_abort_error(2);
+					}
+					slot_move(*function, std::move(result));
+					tempsTop -= static_cast<Offset>(argsCount + 1);
+					instOffset += 2;
+					opcode_dispatch();
+				}
+
+				if (!state._calls.push(callable, state._values.offset_of(vars), 0, instOffset + 2))
+				{
+					state.setError(callable->heap().intern("call stack overflow"));
+					opcode_abort_error(2);
+				}
+
+				callable = &function->function().callable();
+				vars = function + 2;
+				if (!state._values.push_frame(vars, std::min(argsCount, callable->varsCount()), callable->stackCount() + 1))
+				{
+					state.setError(callable->heap().intern("value stack overflow"));
+					opcode_abort_error(2);
+				}
+				self = vars + callable->varsCount();
+				data::Value::swap(*self, vars[-1]);
+				temps = self + 1;
+				tempsTop = 0;
+				instOffset = 0;
+				insts = callable->code();
+			opcode_end(0);
+
+			/* Reuses the current frame and CallInfo: the callee and its arguments slide down over them */
+			opcode_case(TAILCALL)
+				Size argsCount = get_ubyte(1);
+				data::Value* function = temps + (tempsTop - argsCount - 2);
+				check_function(*function, 2);
+
+				/* A native callee runs here, its result is returned as by RETURN */
+				if (function->function().isNative())
+				{
+					data::Value result;
+					if (!function->function().native()(state, function->function(), function[1], function + 2, argsCount, result))
+					{
+						opcode_abort_error(2);
+					}
+					slot_move(*function, std::move(result));
+					tempsTop = static_cast<Offset>(function - temps) + 1;
+					goto return_zone;
+				}
+
+				callable = &function->function().callable();
+				data::Value::swap(vars[-2], function[0]);
+				data::Value::swap(vars[-1], function[1]);
+				argsCount = std::min(argsCount, callable->varsCount());
+				for (Offset i = 0; i < argsCount; ++i)
+					data::Value::swap(vars[i], function[2 + i]);
+
+				if (!state._values.push_frame(vars, argsCount, callable->stackCount() + 1))
+				{
+					state.setError(callable->heap().intern("value stack overflow"));
+					opcode_abort_error(2);
+				}
+				self = vars + callable->varsCount();
+				data::Value::swap(*self, vars[-1]);
+				temps = self + 1;
+				tempsTop = 0;
+				instOffset = 0;
+				insts = callable->code();
+			opcode_end(0);
+
+			opcode_case(YIELD)
+				if (!yieldable)
+				{
+					state.setError(callable->heap().intern(state._fiber ? "yield across a native call" : "yield outside of a fiber"));
+					opcode_abort_error(1);
+				}
+			opcode_end_and_jump(1, yield_zone);
+
+			/* The fiber runs in an activation of its own, on its own stacks, and its result replaces the fiber operand */
+			opcode_case(RESUME)
+				data::Value& target = temps[tempsTop - 2];
+				if (target.type() != data::DataType::Userdata || !target.userdata().is<Fiber>())
+				{
+					state.setError(callable->heap().intern("resume of a non-fiber value"));
+					opcode_abort_error(1);
+				}
+
+				data::Value result = target.userdata().as<Fiber>()->resume(state, temps + (tempsTop - 1), 1);
+				check_errors(1);
+				slot_move(target, std::move(result));
+				--tempsTop;
+			opcode_end(1);
+
+			/*
+			 * Only a graph referenced by nothing but the var is sent. Popped temps may still hold it, they are
+			 * cleared first, and the var reference is handed to a counted local so that packing can take it.
+			 */
+			opcode_case(SEND)
+				data::Value& target = temps[tempsTop - 1];
+				if (target.type() != data::DataType::Userdata || !target.userdata().is<std::shared_ptr<Channel>>())
+				{
+					state.setError(callable->heap().intern("send to a non-channel value"));
+					opcode_abort_error(2);
+				}
+
+				for (Offset i = tempsTop; i < callable->tempsCount(); ++i)
+					slot_move(temps[i], data::Value());
+
+				data::Value& var = vars[get_ubyte(1)];
+				data::Value message = var;
+				slot_move(var, data::Value());
+
+				Channel::Status status = (*target.userdata().as<std::shared_ptr<Channel>>())->send(callable->heap(), message);
+				if (status != Channel::Status::Sent)
+				{
+					slot_move(var, std::move(message));
+					if (status == Channel::Status::Rejected)
+					{
+						state.setError(callable->heap().intern("cannot send a value referenced elsewhere"));
+						opcode_abort_error(2);
+					}
+				}
+				slot_move(target, data::Value(status == Channel::Status::Sent));
 			opcode_end(2);
+
+			opcode_case(RECEIVE)
+				data::Value& target = temps[tempsTop - 1];
+				if (target.type() != data::DataType::Userdata || !target.userdata().is<std::shared_ptr<Channel>>())
+				{
+					state.setError(callable->heap().intern("receive from a non-channel value"));
+					opcode_abort_error(1);
+				}
+
+				data::Value message;
+				(*target.userdata().as<std::shared_ptr<Channel>>())->receive(callable->heap(), message);
+				slot_move(target, std::move(message));
+			opcode_end(1);
+
+			opcode_case(RETURN)
+			opcode_end_and_jump(0, return_zone);
+		opcode_dispatch_end()
+
+		/* Frames and CallInfos stay on the stacks of the state, the registers are parked for resume */
+	yield_zone:
+		--tempsTop;
+		state._suspended = { callable, state._values.offset_of(vars), frameBottom, tempsTop, instOffset };
+		return temps[tempsTop];
+
+		/* Shared by RETURN and a native TAILCALL: the result is on top of the temps */
+	return_zone:
+		{
+			CallInfo* caller = state._calls.pop();
+			if (!caller->callable)
+			{
+				data::Value result = temps[tempsTop - 1];
+				state._values.pop(frameBottom);
+				return result;
+			}
+
+			/* The result takes the place of the callee Function in the caller temps */
+			data::Value::swap(vars[-2], temps[tempsTop - 1]);
+			data::Value* result = vars - 2;
+
+			callable = caller->callable;
+			state._values.pop_frame(vars, state._values.at(caller->bottom) + callable->stackCount() + 1);
+			vars = state._values.at(caller->bottom);
+			self = vars + callable->varsCount();
+			temps = self + 1;
+			tempsTop = static_cast<Offset>(result - temps) + 1;
+			instOffset = caller->offset;
+			insts = callable->code();
 		}
+		opcode_dispatch();
 
 	error_zone:
+		/* The script frames of this activation sit above its native CallInfo */
+		for (CallInfo* caller = state._calls.pop(); caller && caller->callable; caller = state._calls.pop());
+		state._values.pop(frameBottom);
 		return data::Value();
 	}
 }
@@ -0,0 +1,154 @@
+#include "scheduler.h"
+
+namespace k::runtime
+{
+	/* Scheduler and worker index of the running thread, submissions from a worker stay on its deque */
+	static thread_local const Scheduler* current_scheduler = nullptr;
+	static thread_local Size current_worker = 0;
+	static thread_local Isolate* current_isolate = nullptr;
+
+	/* Failed rounds a worker spins with a pending task in sight before it starts to sleep between rounds */
+	static constexpr Size spin_rounds = 16;
+
+	Scheduler::Scheduler(Size threads)
+	{
+		_workers.reserve(threads);
+		for (Size i = 0; i < threads; ++i)
+			_workers.push_back(std::make_unique<Worker>());
+
+		for (Size i = 0; i < threads; ++i)
+			_workers[i]->thread = std::thread(&Scheduler::work, this, i);
+	}
+
+	Scheduler::~Scheduler()
+	{
+		{
+			std::lock_guard<std::mutex> guard(_sleepLock);
+			_stopping = true;
+		}
+		_wake.notify_all();
+
+		for (auto& worker : _workers)
+			worker->thread.join();
+	}
+
+	void Scheduler::push(Task&& task)
+	{
+		_pending.fetch_add(1);
+		Size index = current_scheduler == this ? current_worker : _next.fetch_add(1, std::memory_order_relaxed) % _workers.size();
+		{
+			Worker& worker = *_workers[index];
+			std::lock_guard<std::mutex> guard(worker.lock);
+			worker.tasks.push_back(std::move(task));
+		}
+
+		/* Pairs with take: either a sleeper is seen here or the sleeper sees the pending task */
+		if (_sleeping.load() > 0)
+		{
+			std::lock_guard<std::mutex> guard(_sleepLock);
+			_wake.notify_one();
+		}
+	}
+
+	void Scheduler::work(Size index)
+	{
+		current_scheduler = this;
+		current_worker = index;
+
+		/* Built on the worker thread, so its pages are first touched there */
+		Isolate isolate;
+		current_isolate = &isolate;
+		Task task;
+		while (take(index, task))
+		{
+			task(isolate);
+			task = nullptr;
+		}
+	}
+
+	bool Scheduler::isWorker() const
+	{
+		return current_scheduler == this;
+	}
+
+	bool Scheduler::run_one()
+	{
+		Task task;
+		if (!isWorker() || !(pop(current_worker, task) || steal(current_worker, task)))
+			return false;
+
+		_pending.fetch_sub(1);
+		task(*current_isolate);
+		return true;
+	}
+
+	bool Scheduler::take(Size index, Task& task)
+	{
+		Size rounds = 0;
+		std::chrono::microseconds backoff{ 1 };
+		for (;;)
+		{
+			if (pop(index, task) || steal(index, task))
+			{
+				_pending.fetch_sub(1);
+				return true;
+			}
+
+			/*
+			 * A pending task that cannot be taken is still being pushed, or sits behind a contended deque lock:
+			 * yield a few rounds, then sleep with a growing timeout instead of spinning on the predicate.
+			 */
+			if (_pending.load() > 0 && ++rounds <= spin_rounds)
+			{
+				std::this_thread::yield();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(_sleepLock);
+			_sleeping.fetch_add(1);
+			if (_pending.load() > 0)
+			{
+				_wake.wait_for(lock, backoff);
+				backoff = std::min(backoff * 2, max_backoff);
+			}
+			else
+			{
+				_wake.wait(lock, [this]() { return _pending.load() > 0 || _stopping; });
+				rounds = 0;
+				backoff = std::chrono::microseconds(1);
+			}
+			_sleeping.fetch_sub(1);
+
+			if (_stopping && _pending.load() == 0)
+				return false;
+		}
+	}
+
+	bool Scheduler::pop(Size index, Task& task)
+	{
+		Worker& worker = *_workers[index];
+		std::lock_guard<std::mutex> guard(worker.lock);
+		if (worker.tasks.empty())
+			return false;
+
+		task = std::move(worker.tasks.back());
+		worker.tasks.pop_back();
+		return true;
+	}
+
+	bool Scheduler::steal(Size index, Task& task)
+	{
+		for (Size i = 1; i < _workers.size(); ++i)
+		{
+			Worker& victim = *_workers[(index + i) % _workers.size()];
+			std::unique_lock<std::mutex> guard(victim.lock, std::try_to_lock);
+			if (!guard.owns_lock() || victim.tasks.empty())
+				continue;
+
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+		return false;
+	}
+}
@@ -0,0 +1,114 @@
+#include "shared_region.h"
+
+namespace k::mem
+{
+	SharedRegion::~SharedRegion()
+	{
+		/* Values between frozen blocks release nothing, the blocks can go in any order */
+		for (MemoryBlock* block : _blocks)
+			delete block;
+		_blocks.clear();
+
+#if K_NAN_BOXING
+		for (data::Value::IntegerBox* box : _boxes)
+			delete box;
+		_boxes.clear();
+#endif
+	}
+
+	data::Value SharedRegion::freeze(const data::Value& value)
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+
+		Copies copies;
+		std::vector<Pending> pending;
+		data::Value result = copy(value, copies, pending);
+		while (!pending.empty())
+		{
+			Pending next = pending.back();
+			pending.pop_back();
+			copy_elements(next, copies, pending);
+		}
+		return result;
+	}
+
+	Size SharedRegion::blockCount()
+	{
+		std::lock_guard<std::mutex> guard(_lock);
+		return _blocks.size();
+	}
+
+	data::Value SharedRegion::copy(const data::Value& value, Copies& copies, std::vector<Pending>& pending)
+	{
+		if (!value.is_block() || value.isFrozen())
+		{
+			data::Value result = value;
+			seal(result);
+			return result;
+		}
+
+		const auto& it = copies.find(value.block());
+		if (it != copies.end())
+			return it->second;
+
+		data::Value result;
+		switch (value.type())
+		{
+			case data::DataType::String:
+				result = allocate<data::String>(value.string().view());
+				break;
+
+			case data::DataType::Array:
+				result = allocate<data::Array>();
+				pending.push_back({ data::DataType::Array, value.block(), result.block() });
+				break;
+
+			case data::DataType::Object:
+				result = allocate<data::Object>(_rootShape);
+				pending.push_back({ data::DataType::Object, value.block(), result.block() });
+				break;
+
+			default:
+				throw error::RuntimeError("only Strings, Arrays and Objects can be frozen");
+		}
+		copies.emplace(value.block(), result);
+		return result;
+	}
+
+	void SharedRegion::copy_elements(const Pending& next, Copies& copies, std::vector<Pending>& pending)
+	{
+		if (next.type == data::DataType::Array)
+		{
+			const data::Array& source = static_cast<const data::Array&>(*next.source);
+			data::Array& array = static_cast<data::Array&>(*next.copy);
+			for (Offset i = 0; i < source.size(); ++i)
+				array.push_back(copy(source.get(i), copies, pending));
+			return;
+		}
+
+		/* Properties are replayed in slot order, so the copy keeps the slot indexes of the source */
+		const data::Object& source = static_cast<const data::Object&>(*next.source);
+		data::Object& object = static_cast<data::Object&>(*next.copy);
+		source.shape().for_each([&](const std::string& name, const data::Shape::Slot& slot) {
+			object.add_property(name, slot.isConst, copy(source.slot(slot.index), copies, pending));
+		});
+		object._parent = copy(source.parent(), copies, pending);
+		object._class = copy(source.objectClass(), copies, pending);
+	}
+
+	void SharedRegion::seal([[maybe_unused]] data::Value& slot)
+	{
+#if K_NAN_BOXING
+		if ((slot._bits >> data::Value::tag_shift) != data::Value::tag_boxed_integer ||
+			reinterpret_cast<data::Value::IntegerBox*>(slot._bits & data::Value::payload_mask)->refs == data::Value::IntegerBox::immortal)
+		{
+			return;
+		}
+
+		data::Value::IntegerBox* box = new data::Value::IntegerBox{ data::Value::IntegerBox::immortal, slot.integer() };
+		slot.release_box();
+		slot._bits = (data::Value::tag_boxed_integer << data::Value::tag_shift) | reinterpret_cast<UInt64>(box);
+		_boxes.push_back(box);
+#endif
+	}
+}
@@ -0,0 +1,614 @@
+#include "simd.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#	define K_SIMD_X86 1
+#	include <immintrin.h>
+#	if defined(_MSC_VER) && !defined(__clang__)
+#		include <intrin.h>
+#		define K_TARGET_AVX2
+#	else
+#		define K_TARGET_AVX2 __attribute__((target("avx2")))
+#	endif
+#else
+#	define K_SIMD_X86 0
+#endif
+
+namespace k::simd
+{
+	namespace
+	{
+		/* Shared by every level: the in-order folds of the lanes and of the tail */
+		inline double real_min(double left, double right) { return right < left ? right : left; }
+		inline double real_max(double left, double right) { return right > left ? right : left; }
+
+		inline double combine_lanes_sum(const double* lanes) { return (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]); }
+		inline double combine_lanes_min(const double* lanes) { return real_min(real_min(lanes[0], lanes[2]), real_min(lanes[1], lanes[3])); }
+		inline double combine_lanes_max(const double* lanes) { return real_max(real_max(lanes[0], lanes[2]), real_max(lanes[1], lanes[3])); }
+	}
+
+	namespace scalar
+	{
+		void fill_integer(Int64* dst, Size count, Int64 value) { std::fill(dst, dst + count, value); }
+		void fill_real(double* dst, Size count, double value) { std::fill(dst, dst + count, value); }
+
+		bool sum_integer(const Int64* src, Size count, Int64* sum)
+		{
+			bool overflow = false;
+			*sum = 0;
+			for (Offset i = 0; i < count; ++i)
+				overflow |= utils::add_overflow(*sum, src[i], sum);
+			return overflow;
+		}
+
+		double sum_real(const double* src, Size count)
+		{
+			double lanes[4] = { 0, 0, 0, 0 };
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+				for (Offset lane = 0; lane < 4; ++lane)
+					lanes[lane] += src[i + lane];
+
+			double sum = combine_lanes_sum(lanes);
+			for (; i < count; ++i)
+				sum += src[i];
+			return sum;
+		}
+
+		Size count_true(const UInt8* src, Size count)
+		{
+			Size sum = 0;
+			for (Offset i = 0; i < count; ++i)
+				sum += src[i];
+			return sum;
+		}
+
+		Int64 min_integer(const Int64* src, Size count) { return *std::min_element(src, src + count); }
+		Int64 max_integer(const Int64* src, Size count) { return *std::max_element(src, src + count); }
+
+		template<double (*_Op)(double, double), double (*_Combine)(const double*)>
+		double reduce_real(const double* src, Size count)
+		{
+			double lanes[4] = { src[0], src[0], src[0], src[0] };
+			bool nan = false;
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				for (Offset lane = 0; lane < 4; ++lane)
+				{
+					nan |= src[i + lane] != src[i + lane];
+					lanes[lane] = _Op(lanes[lane], src[i + lane]);
+				}
+			}
+
+			double result = _Combine(lanes);
+			for (; i < count; ++i)
+			{
+				nan |= src[i] != src[i];
+				result = _Op(result, src[i]);
+			}
+			return nan || src[0] != src[0] ? std::numeric_limits<double>::quiet_NaN() : result;
+		}
+
+		double min_real(const double* src, Size count) { return reduce_real<real_min, combine_lanes_min>(src, count); }
+		double max_real(const double* src, Size count) { return reduce_real<real_max, combine_lanes_max>(src, count); }
+
+		bool add_integer(Int64* dst, const Int64* left, const Int64* right, Size count)
+		{
+			bool overflow = false;
+			for (Offset i = 0; i < count; ++i)
+				overflow |= utils::add_overflow(left[i], right[i], dst + i);
+			return overflow;
+		}
+
+		bool mul_integer(Int64* dst, const Int64* left, const Int64* right, Size count)
+		{
+			bool overflow = false;
+			for (Offset i = 0; i < count; ++i)
+				overflow |= utils::mul_overflow(left[i], right[i], dst + i);
+			return overflow;
+		}
+
+		void add_real(double* dst, const double* left, const double* right, Size count)
+		{
+			for (Offset i = 0; i < count; ++i)
+				dst[i] = left[i] + right[i];
+		}
+
+		void mul_real(double* dst, const double* left, const double* right, Size count)
+		{
+			for (Offset i = 0; i < count; ++i)
+				dst[i] = left[i] * right[i];
+		}
+
+		Offset index_of_integer(const Int64* src, Size count, Int64 value) { return std::find(src, src + count, value) - src; }
+		Offset index_of_real(const double* src, Size count, double value) { return std::find(src, src + count, value) - src; }
+
+		bool equal_real(const double* left, const double* right, Size count) { return std::equal(left, left + count, right); }
+
+		constexpr Kernels kernels = {
+			fill_integer, fill_real,
+			sum_integer, sum_real, count_true,
+			min_integer, max_integer, min_real, max_real,
+			add_integer, mul_integer, add_real, mul_real,
+			index_of_integer, index_of_real,
+			equal_real,
+		};
+	}
+
+#if K_SIMD_X86
+	namespace sse2
+	{
+		void fill_integer(Int64* dst, Size count, Int64 value)
+		{
+			__m128i v = _mm_set1_epi64x(value);
+			Offset i = 0;
+			for (; i + 2 <= count; i += 2)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+			for (; i < count; ++i)
+				dst[i] = value;
+		}
+
+		void fill_real(double* dst, Size count, double value)
+		{
+			__m128d v = _mm_set1_pd(value);
+			Offset i = 0;
+			for (; i + 2 <= count; i += 2)
+				_mm_storeu_pd(dst + i, v);
+			for (; i < count; ++i)
+				dst[i] = value;
+		}
+
+		/* Sign bit set in the lanes where sum = left + right overflowed */
+		inline __m128i add_overflows(__m128i sum, __m128i left, __m128i right)
+		{
+			return _mm_and_si128(_mm_xor_si128(sum, left), _mm_xor_si128(sum, right));
+		}
+
+		bool sum_integer(const Int64* src, Size count, Int64* sum)
+		{
+			__m128i lanesSum = _mm_setzero_si128(), overflows = _mm_setzero_si128();
+			Offset i = 0;
+			for (; i + 2 <= count; i += 2)
+			{
+				__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+				__m128i next = _mm_add_epi64(lanesSum, x);
+				overflows = _mm_or_si128(overflows, add_overflows(next, lanesSum, x));
+				lanesSum = next;
+			}
+
+			alignas(16) Int64 lanes[2];
+			_mm_store_si128(reinterpret_cast<__m128i*>(lanes), lanesSum);
+			Int64 tail;
+			bool overflow = _mm_movemask_pd(_mm_castsi128_pd(overflows)) != 0;
+			overflow |= utils::add_overflow(lanes[0], lanes[1], sum);
+			overflow |= scalar::sum_integer(src + i, count - i, &tail);
+			overflow |= utils::add_overflow(*sum, tail, sum);
+			return overflow;
+		}
+
+		double sum_real(const double* src, Size count)
+		{
+			__m128d low = _mm_setzero_pd(), high = _mm_setzero_pd();
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				low = _mm_add_pd(low, _mm_loadu_pd(src + i));
+				high = _mm_add_pd(high, _mm_loadu_pd(src + i + 2));
+			}
+
+			alignas(16) double lanes[4];
+			_mm_store_pd(lanes, low);
+			_mm_store_pd(lanes + 2, high);
+			double sum = combine_lanes_sum(lanes);
+			for (; i < count; ++i)
+				sum += src[i];
+			return sum;
+		}
+
+		Size count_true(const UInt8* src, Size count)
+		{
+			__m128i sum = _mm_setzero_si128();
+			Offset i = 0;
+			for (; i + 16 <= count; i += 16)
+				sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), _mm_setzero_si128()));
+
+			alignas(16) UInt64 lanes[2];
+			_mm_store_si128(reinterpret_cast<__m128i*>(lanes), sum);
+			Size result = static_cast<Size>(lanes[0] + lanes[1]);
+			for (; i < count; ++i)
+				result += src[i];
+			return result;
+		}
+
+		template<bool _Max>
+		double reduce_real(const double* src, Size count)
+		{
+			__m128d low = _mm_set1_pd(src[0]), high = low, nan = _mm_setzero_pd();
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m128d a = _mm_loadu_pd(src + i), b = _mm_loadu_pd(src + i + 2);
+				nan = _mm_or_pd(nan, _mm_or_pd(_mm_cmpunord_pd(a, a), _mm_cmpunord_pd(b, b)));
+				/* min_pd(x, y) is x < y ? x : y, the operand order matches real_min(lane, x) */
+				low = _Max ? _mm_max_pd(a, low) : _mm_min_pd(a, low);
+				high = _Max ? _mm_max_pd(b, high) : _mm_min_pd(b, high);
+			}
+
+			alignas(16) double lanes[4];
+			_mm_store_pd(lanes, low);
+			_mm_store_pd(lanes + 2, high);
+			double result = _Max ? combine_lanes_max(lanes) : combine_lanes_min(lanes);
+			bool anyNan = _mm_movemask_pd(nan) != 0 || src[0] != src[0];
+			for (; i < count; ++i)
+			{
+				anyNan |= src[i] != src[i];
+				result = _Max ? real_max(result, src[i]) : real_min(result, src[i]);
+			}
+			return anyNan ? std::numeric_limits<double>::quiet_NaN() : result;
+		}
+
+		double min_real(const double* src, Size count) { return reduce_real<false>(src, count); }
+		double max_real(const double* src, Size count) { return reduce_real<true>(src, count); }
+
+		bool add_integer(Int64* dst, const Int64* left, const Int64* right, Size count)
+		{
+			__m128i overflows = _mm_setzero_si128();
+			Offset i = 0;
+			for (; i + 2 <= count; i += 2)
+			{
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left + i));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right + i));
+				__m128i sum = _mm_add_epi64(a, b);
+				overflows = _mm_or_si128(overflows, add_overflows(sum, a, b));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), sum);
+			}
+			bool overflow = _mm_movemask_pd(_mm_castsi128_pd(overflows)) != 0;
+			overflow |= scalar::add_integer(dst + i, left + i, right + i, count - i);
+			return overflow;
+		}
+
+		void add_real(double* dst, const double* left, const double* right, Size count)
+		{
+			Offset i = 0;
+			for (; i + 2 <= count; i += 2)
+				_mm_storeu_pd(dst + i, _mm_add_pd(_mm_loadu_pd(left + i), _mm_loadu_pd(right + i)));
+			scalar::add_real(dst + i, left + i, right + i, count - i);
+		}
+
+		void mul_real(double* dst, const double* left, const double* right, Size count)
+		{
+			Offset i = 0;
+			for (; i + 2 <= count; i += 2)
+				_mm_storeu_pd(dst + i, _mm_mul_pd(_mm_loadu_pd(left + i), _mm_loadu_pd(right + i)));
+			scalar::mul_real(dst + i, left + i, right + i, count - i);
+		}
+
+		Offset index_of_integer(const Int64* src, Size count, Int64 value)
+		{
+			__m128i key = _mm_set1_epi64x(value);
+			Offset i = 0;
+			for (; i + 2 <= count; i += 2)
+			{
+				/* No 64-bit compare before SSE4.1: both 32-bit halves must match */
+				__m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), key);
+				eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+				if (int mask = _mm_movemask_pd(_mm_castsi128_pd(eq)))
+					return i + std::countr_zero(static_cast<unsigned>(mask));
+			}
+			return i + scalar::index_of_integer(src + i, count - i, value);
+		}
+
+		Offset index_of_real(const double* src, Size count, double value)
+		{
+			__m128d key = _mm_set1_pd(value);
+			Offset i = 0;
+			for (; i + 2 <= count; i += 2)
+			{
+				if (int mask = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(src + i), key)))
+					return i + std::countr_zero(static_cast<unsigned>(mask));
+			}
+			return i + scalar::index_of_real(src + i, count - i, value);
+		}
+
+		bool equal_real(const double* left, const double* right, Size count)
+		{
+			Offset i = 0;
+			for (; i + 2 <= count; i += 2)
+			{
+				if (_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(left + i), _mm_loadu_pd(right + i))) != 0x3)
+					return false;
+			}
+			return scalar::equal_real(left + i, right + i, count - i);
+		}
+
+		constexpr Kernels kernels = {
+			fill_integer, fill_real,
+			sum_integer, sum_real, count_true,
+			scalar::min_integer, scalar::max_integer, min_real, max_real,
+			add_integer, scalar::mul_integer, add_real, mul_real,
+			index_of_integer, index_of_real,
+			equal_real,
+		};
+	}
+
+	namespace avx2
+	{
+		K_TARGET_AVX2 void fill_integer(Int64* dst, Size count, Int64 value)
+		{
+			__m256i v = _mm256_set1_epi64x(value);
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+			for (; i < count; ++i)
+				dst[i] = value;
+		}
+
+		K_TARGET_AVX2 void fill_real(double* dst, Size count, double value)
+		{
+			__m256d v = _mm256_set1_pd(value);
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+				_mm256_storeu_pd(dst + i, v);
+			for (; i < count; ++i)
+				dst[i] = value;
+		}
+
+		K_TARGET_AVX2 inline __m256i add_overflows(__m256i sum, __m256i left, __m256i right)
+		{
+			return _mm256_and_si256(_mm256_xor_si256(sum, left), _mm256_xor_si256(sum, right));
+		}
+
+		K_TARGET_AVX2 bool sum_integer(const Int64* src, Size count, Int64* sum)
+		{
+			__m256i lanesSum = _mm256_setzero_si256(), overflows = _mm256_setzero_si256();
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+				__m256i next = _mm256_add_epi64(lanesSum, x);
+				overflows = _mm256_or_si256(overflows, add_overflows(next, lanesSum, x));
+				lanesSum = next;
+			}
+
+			alignas(32) Int64 lanes[4];
+			_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), lanesSum);
+			Int64 tail;
+			bool overflow = _mm256_movemask_pd(_mm256_castsi256_pd(overflows)) != 0;
+			overflow |= scalar::sum_integer(lanes, 4, sum);
+			overflow |= scalar::sum_integer(src + i, count - i, &tail);
+			overflow |= utils::add_overflow(*sum, tail, sum);
+			return overflow;
+		}
+
+		K_TARGET_AVX2 double sum_real(const double* src, Size count)
+		{
+			__m256d sum = _mm256_setzero_pd();
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+				sum = _mm256_add_pd(sum, _mm256_loadu_pd(src + i));
+
+			alignas(32) double lanes[4];
+			_mm256_store_pd(lanes, sum);
+			double result = combine_lanes_sum(lanes);
+			for (; i < count; ++i)
+				result += src[i];
+			return result;
+		}
+
+		K_TARGET_AVX2 Size count_true(const UInt8* src, Size count)
+		{
+			__m256i sum = _mm256_setzero_si256();
+			Offset i = 0;
+			for (; i + 32 <= count; i += 32)
+				sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), _mm256_setzero_si256()));
+
+			alignas(32) UInt64 lanes[4];
+			_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sum);
+			Size result = static_cast<Size>(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+			for (; i < count; ++i)
+				result += src[i];
+			return result;
+		}
+
+		template<bool _Max>
+		K_TARGET_AVX2 Int64 reduce_integer(const Int64* src, Size count)
+		{
+			__m256i acc = _mm256_set1_epi64x(src[0]);
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+				__m256i replace = _Max ? _mm256_cmpgt_epi64(x, acc) : _mm256_cmpgt_epi64(acc, x);
+				acc = _mm256_blendv_epi8(acc, x, replace);
+			}
+
+			alignas(32) Int64 lanes[4];
+			_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), acc);
+			Int64 result = _Max ? std::max({ lanes[0], lanes[1], lanes[2], lanes[3] }) : std::min({ lanes[0], lanes[1], lanes[2], lanes[3] });
+			for (; i < count; ++i)
+				result = _Max ? std::max(result, src[i]) : std::min(result, src[i]);
+			return result;
+		}
+
+		K_TARGET_AVX2 Int64 min_integer(const Int64* src, Size count) { return reduce_integer<false>(src, count); }
+		K_TARGET_AVX2 Int64 max_integer(const Int64* src, Size count) { return reduce_integer<true>(src, count); }
+
+		template<bool _Max>
+		K_TARGET_AVX2 double reduce_real(const double* src, Size count)
+		{
+			__m256d acc = _mm256_set1_pd(src[0]), nan = _mm256_setzero_pd();
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m256d x = _mm256_loadu_pd(src + i);
+				nan = _mm256_or_pd(nan, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+				acc = _Max ? _mm256_max_pd(x, acc) : _mm256_min_pd(x, acc);
+			}
+
+			alignas(32) double lanes[4];
+			_mm256_store_pd(lanes, acc);
+			double result = _Max ? combine_lanes_max(lanes) : combine_lanes_min(lanes);
+			bool anyNan = _mm256_movemask_pd(nan) != 0 || src[0] != src[0];
+			for (; i < count; ++i)
+			{
+				anyNan |= src[i] != src[i];
+				result = _Max ? real_max(result, src[i]) : real_min(result, src[i]);
+			}
+			return anyNan ? std::numeric_limits<double>::quiet_NaN() : result;
+		}
+
+		K_TARGET_AVX2 double min_real(const double* src, Size count) { return reduce_real<false>(src, count); }
+		K_TARGET_AVX2 double max_real(const double* src, Size count) { return reduce_real<true>(src, count); }
+
+		K_TARGET_AVX2 bool add_integer(Int64* dst, const Int64* left, const Int64* right, Size count)
+		{
+			__m256i overflows = _mm256_setzero_si256();
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left + i));
+				__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right + i));
+				__m256i sum = _mm256_add_epi64(a, b);
+				overflows = _mm256_or_si256(overflows, add_overflows(sum, a, b));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), sum);
+			}
+			bool overflow = _mm256_movemask_pd(_mm256_castsi256_pd(overflows)) != 0;
+			overflow |= scalar::add_integer(dst + i, left + i, right + i, count - i);
+			return overflow;
+		}
+
+		K_TARGET_AVX2 void add_real(double* dst, const double* left, const double* right, Size count)
+		{
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+				_mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(left + i), _mm256_loadu_pd(right + i)));
+			scalar::add_real(dst + i, left + i, right + i, count - i);
+		}
+
+		K_TARGET_AVX2 void mul_real(double* dst, const double* left, const double* right, Size count)
+		{
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+				_mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(left + i), _mm256_loadu_pd(right + i)));
+			scalar::mul_real(dst + i, left + i, right + i, count - i);
+		}
+
+		K_TARGET_AVX2 Offset index_of_integer(const Int64* src, Size count, Int64 value)
+		{
+			__m256i key = _mm256_set1_epi64x(value);
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				__m256i eq = _mm256_cmpeq_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), key);
+				if (int mask = _mm256_movemask_pd(_mm256_castsi256_pd(eq)))
+					return i + std::countr_zero(static_cast<unsigned>(mask));
+			}
+			return i + scalar::index_of_integer(src + i, count - i, value);
+		}
+
+		K_TARGET_AVX2 Offset index_of_real(const double* src, Size count, double value)
+		{
+			__m256d key = _mm256_set1_pd(value);
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				if (int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(src + i), key, _CMP_EQ_OQ)))
+					return i + std::countr_zero(static_cast<unsigned>(mask));
+			}
+			return i + scalar::index_of_real(src + i, count - i, value);
+		}
+
+		K_TARGET_AVX2 bool equal_real(const double* left, const double* right, Size count)
+		{
+			Offset i = 0;
+			for (; i + 4 <= count; i += 4)
+			{
+				if (_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(left + i), _mm256_loadu_pd(right + i), _CMP_EQ_OQ)) != 0xf)
+					return false;
+			}
+			return scalar::equal_real(left + i, right + i, count - i);
+		}
+
+		constexpr Kernels kernels = {
+			fill_integer, fill_real,
+			sum_integer, sum_real, count_true,
+			min_integer, max_integer, min_real, max_real,
+			add_integer, scalar::mul_integer, add_real, mul_real,
+			index_of_integer, index_of_real,
+			equal_real,
+		};
+	}
+#endif
+
+	namespace
+	{
+		Level detect()
+		{
+#if K_SIMD_X86
+#	if defined(_MSC_VER) && !defined(__clang__)
+			int info[4];
+			__cpuid(info, 1);
+			bool osAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 0x6) == 0x6;
+			__cpuidex(info, 7, 0);
+			if (osAvx && (info[1] & (1 << 5)))
+				return Level::AVX2;
+#	else
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2"))
+				return Level::AVX2;
+#	endif
+			return Level::SSE2;
+#else
+			return Level::Scalar;
+#endif
+		}
+
+		const Kernels* table(Level level)
+		{
+			switch (level)
+			{
+#if K_SIMD_X86
+				case Level::AVX2: return &avx2::kernels;
+				case Level::SSE2: return &sse2::kernels;
+#endif
+				default: return &scalar::kernels;
+			}
+		}
+
+		struct Selection
+		{
+			Level detected = detect();
+			Level level = detected;
+			const Kernels* kernels = table(level);
+		};
+
+		Selection& selection()
+		{
+			static Selection selection;
+			return selection;
+		}
+	}
+
+	Level detected() { return selection().detected; }
+
+	Level level() { return selection().level; }
+
+	void select(Level level)
+	{
+		Selection& current = selection();
+		current.level = std::min(level, current.detected);
+		current.kernels = table(current.level);
+	}
+
+	const char* name(Level level)
+	{
+		switch (level)
+		{
+			case Level::AVX2: return "AVX2";
+			case Level::SSE2: return "SSE2";
+			default: return "scalar";
+		}
+	}
+
+	const Kernels& kernels() { return *selection().kernels; }
+}
@@ -0,0 +1,92 @@
+#include "slab.h"
+
+namespace k::mem
+{
+	SlabAllocator::~SlabAllocator()
+	{
+		for (Pool& pool : _pools)
+		{
+			for (Page* list : { pool.available, pool.full })
+			{
+				for (Page* page = list, *next; page; page = next)
+				{
+					next = page->next;
+					::operator delete(page, std::align_val_t(page_size));
+				}
+			}
+			pool.available = pool.full = nullptr;
+		}
+		_pageCount = 0;
+	}
+
+	SlabAllocator::Page* SlabAllocator::new_page(UInt8 sizeClass)
+	{
+		Page* page = reinterpret_cast<Page*>(::operator new(page_size, std::align_val_t(page_size)));
+		Byte* base = reinterpret_cast<Byte*>(page);
+
+		page->owner = this;
+		page->next = nullptr;
+		page->prev = nullptr;
+		page->free = nullptr;
+		page->bump = base + page_header_size;
+		page->end = base + page_size;
+		page->live = 0;
+		page->sizeClass = sizeClass;
+		page->available = true;
+
+		link(_pools[sizeClass].available, page);
+		++_pageCount;
+		return page;
+	}
+
+	void SlabAllocator::retire_page(Page* page)
+	{
+		Pool& pool = _pools[page->sizeClass];
+		unlink(pool.available, page);
+		link(pool.full, page);
+		page->available = false;
+	}
+
+	void SlabAllocator::restore_page(Page* page)
+	{
+		Pool& pool = _pools[page->sizeClass];
+		unlink(pool.full, page);
+		link(pool.available, page);
+		page->available = true;
+	}
+
+	void SlabAllocator::reclaim_page(Page* page)
+	{
+		Pool& pool = _pools[page->sizeClass];
+
+		/* Keep the last available page of a class around so alloc/free bursts do not thrash the system allocator */
+		if (pool.available == page && !page->next)
+			return;
+
+		unlink(pool.available, page);
+		::operator delete(page, std::align_val_t(page_size));
+		--_pageCount;
+	}
+
+	void SlabAllocator::unlink(Page*& list, Page* page)
+	{
+		if (page->prev)
+			page->prev->next = page->next;
+		else
+			list = page->next;
+
+		if (page->next)
+			page->next->prev = page->prev;
+
+		page->next = page->prev = nullptr;
+	}
+
+	void SlabAllocator::link(Page*& list, Page* page)
+	{
+		page->prev = nullptr;
+		page->next = list;
+		if (list)
+			list->prev = page;
+		list = page;
+	}
+}
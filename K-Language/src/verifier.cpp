@@ -0,0 +1,137 @@
+#include "verifier.h"
+
+namespace k::verifier
+{
+	namespace
+	{
+		[[noreturn]] void reject(Offset offset, const std::string& msg)
+		{
+			throw error::BytecodeError("invalid bytecode at " + std::to_string(offset) + ": " + msg);
+		}
+
+		void check_var(Offset offset, Size index, Size varsCount)
+		{
+			if (index >= varsCount)
+				reject(offset, "variable " + std::to_string(index) + " out of range");
+		}
+
+		void check_constant(Offset offset, Size index, Size constantsCount)
+		{
+			if (index >= constantsCount)
+				reject(offset, "constant " + std::to_string(index) + " out of range");
+		}
+	}
+
+	Size verify(
+		const instruction::InstructionValue* code,
+		Size size,
+		Size varsCount,
+		const Chunk::Constant::Type* constantTypes,
+		Size constantsCount
+	) {
+		using namespace instruction::arg;
+
+		static constexpr Size unvisited = static_cast<Size>(-1);
+
+		/* Stack depth on entry of each instruction start, every path reaching it must agree */
+		std::vector<Size> depths(size, unvisited);
+		std::vector<Offset> pending;
+		Size maxDepth = 0;
+
+		auto reach = [&](Offset from, Offset target, Size depth) {
+			if (target >= size)
+				reject(from, "execution runs past the end of the code");
+
+			if (depths[target] == unvisited)
+			{
+				depths[target] = depth;
+				pending.push_back(target);
+			}
+			else if (depths[target] != depth)
+				reject(target, "inconsistent stack depth between paths");
+		};
+
+		reach(0, 0, 0);
+		while (!pending.empty())
+		{
+			Offset offset = pending.back();
+			pending.pop_back();
+
+			if (code[offset] >= opcode::count)
+				reject(offset, "unknown opcode " + std::to_string(code[offset]));
+
+			Opcode op = static_cast<Opcode>(code[offset]);
+			const opcode::Info& info = opcode::info(op);
+			if (opcode::isQuickened(op))
+				reject(offset, std::string("quickened opcode ") + info.name + " in input code");
+			if (offset + info.size > size)
+				reject(offset, std::string("truncated ") + info.name);
+
+			const instruction::InstructionValue* args = code + offset + 1;
+			Size pops = info.pops;
+			if (op == Opcode::CALL || op == Opcode::TAILCALL)
+				pops += get<ubyte>(args);
+
+			Size depth = depths[offset];
+			if (depth < pops)
+				reject(offset, std::string("stack underflow in ") + info.name);
+
+			switch (op)
+			{
+				case Opcode::LOAD_0: case Opcode::STORE_0: check_var(offset, 0, varsCount); break;
+				case Opcode::LOAD_1: case Opcode::STORE_1: check_var(offset, 1, varsCount); break;
+				case Opcode::LOAD_2: case Opcode::STORE_2: check_var(offset, 2, varsCount); break;
+				case Opcode::LOAD_3: case Opcode::STORE_3: check_var(offset, 3, varsCount); break;
+
+				case Opcode::LOAD:
+				case Opcode::STORE:
+				case Opcode::SEND:
+					check_var(offset, get<ubyte>(args), varsCount);
+					break;
+
+				case Opcode::LOAD_STORE:
+					check_var(offset, get<ubyte>(args), varsCount);
+					check_var(offset, get<ubyte>(args + 1), varsCount);
+					break;
+
+				case Opcode::LOADC_I_STORE:
+					check_var(offset, get<ubyte>(args + 1), varsCount);
+					break;
+
+				case Opcode::LOADC: check_constant(offset, get<ubyte>(args), constantsCount); break;
+				case Opcode::LOADCW: check_constant(offset, get<uword>(args), constantsCount); break;
+				case Opcode::LOADCL: check_constant(offset, get<ulong>(args), constantsCount); break;
+
+				case Opcode::ARRAY_REDUCE:
+					if (get<ubyte>(args) >= opcode::array_reduce_count)
+						reject(offset, "unknown ARRAY_REDUCE operation " + std::to_string(get<ubyte>(args)));
+					break;
+
+				case Opcode::ARRAY_OP:
+					if (get<ubyte>(args) >= opcode::array_op_count)
+						reject(offset, "unknown ARRAY_OP operation " + std::to_string(get<ubyte>(args)));
+					break;
+
+				case Opcode::GET_PROP:
+				case Opcode::SET_PROP:
+				case Opcode::GET_METHOD:
+					check_constant(offset, get<uword>(args), constantsCount);
+					if (constantTypes[get<uword>(args)] != Chunk::Constant::Type::String)
+						reject(offset, std::string(info.name) + " name is not a String constant");
+					break;
+
+				default:
+					break;
+			}
+
+			maxDepth = std::max(maxDepth, depth - pops + info.pushes);
+
+			if (op == Opcode::RETURN || op == Opcode::TAILCALL)
+				continue;
+
+			reach(offset, offset + info.size, depth - pops + info.pushes);
+		}
+
+		return maxDepth;
+	}
+}